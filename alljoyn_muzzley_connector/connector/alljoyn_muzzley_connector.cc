@@ -32,6 +32,7 @@
 //GUPnP
 #include <libgupnp/gupnp.h>
 #include <libgssdp/gssdp.h>
+#include <libsoup/soup.h>
 
 
 //Muzzley
@@ -44,11 +45,6 @@
 #include <muzzley/parsers/http.h>
 #include <muzzley/stream/SSLSocketStreams.h>
 
-//Semaphore
-#include <sys/types.h>
-#include <sys/ipc.h>
-#include <sys/sem.h>
-
 //Unordered_map
 #include <unordered_map>
 #include <tuple>
@@ -66,10 +62,68 @@
 //Thread
 #include <iostream>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <memory>
 
 //SHA256
 #include "sha256.h"
 
+//Muzzley read requests
+#include <MuzzleyRequestTable.h>
+
+//Scheduler
+#include <MuzzleyScheduler.h>
+
+//Coalesced controller service calls
+#include <MuzzleyPendingCalls.h>
+
+//Lamp state shadow cache
+#include <MuzzleyLampCache.h>
+
+//Delta publishing
+#include <MuzzleyChangeDetector.h>
+
+//Muzzley client writers
+#include <MuzzleyPublisher.h>
+
+//Lamp write coalescing
+#include <MuzzleyWriteCoalescer.h>
+
+//Known lamps
+#include <MuzzleyLampRegistry.h>
+
+//Known plugs
+#include <MuzzleyPlugRegistry.h>
+
+//Plug metering
+#include <MuzzleyMeterHistory.h>
+#include <MuzzleyMeterSampler.h>
+#include <MuzzleyEnergyStore.h>
+
+//Plug control panel layouts
+#include <MuzzleyWidgetLayouts.h>
+
+//Lamp name queries
+#include <MuzzleyNameResolver.h>
+
+//Keep-alive HTTP connections
+#include <MuzzleyHTTPPool.h>
+
+//Component changes for the global manager
+#include <MuzzleyComponentSync.h>
+
+//Component sets acknowledged by the global manager
+#include <MuzzleyComponentLedger.h>
+
+//Retry delays
+#include <MuzzleyBackoff.h>
+
+//UPnP device descriptions
+#include <MuzzleyDescription.h>
+
 //Alljoyn Services
 #include <CommonSampleUtil.h>
 #include <AnnounceHandlerImpl.h>
@@ -105,7 +159,6 @@
 #define MUZZLEY_DEFAULT_API_PORT 80
 #define MUZZLEY_DEFAULT_MANAGER_PORT 80
 
-#define MUZZLEY_DEFAULT_SEMAPHORE_FILENAME "muzzley_semaphore.txt"
 #define MUZZLEY_DEFAULT_MANAGER_REGISTER_URL "/deviceapp/register"
 #define MUZZLEY_DEFAULT_MANAGER_COMPONENTS_URL "/deviceapp/components"
 #define MUZZLEY_DEFAULT_LIGHTING_DEVICEKEY_FILENAME "lighting_key.key"
@@ -120,6 +173,7 @@
 #define MUZZLEY_LOOPASSYNCHRONOUS true
 #define MUZZLEY_BRIDGE_INFO false
 #define MUZZLEY_READ_REQUEST_TIMEOUT 30
+#define MUZZLEY_READ_REQUEST_CLEANER_INTERVAL 1
 
 #define COLOR_WHITE "white"
 #define COLOR_SILVER "silver"
@@ -150,7 +204,10 @@
 
 #define GUPNP_MAX_AGE 1800
 #define GUPNP_MESSAGE_DELAY 120
-#define LSF_LAMPMANAGER_SLEEP 200000
+#define LSF_LAMPSTATE_INFLIGHT_WINDOW 10
+#define LSF_METHOD_GETLAMPSTATE "GetLampState"
+#define LSF_METHOD_GETALLLAMPIDS "GetAllLampIDs"
+#define LSF_TRANSITION_REPLY_TIMEOUT 3000
 
 #define DEVICE_PLUG "plug"
 #define DEVICE_BULB "bulb"
@@ -184,6 +241,39 @@
 #define MUZZLEY_DEFAULT_NETWORK_LIGHTING_PORT 50000
 #define MUZZLEY_DEFAULT_NETWORK_PLUGS_PORT 51000
 #define MUZZLEY_DEFAULT_STATUS_INTERVAL 60
+#define MUZZLEY_DEFAULT_STATE_CACHE_TTL 30
+#define MUZZLEY_DEFAULT_BRIGHTNESS_THRESHOLD 0.02
+#define MUZZLEY_DEFAULT_COLOR_THRESHOLD 2
+#define MUZZLEY_DEFAULT_SETTLE_DELAY 500
+#define MUZZLEY_DEFAULT_WRITE_WINDOW 100
+#define MUZZLEY_WRITE_STATUS 0
+#define MUZZLEY_WRITE_BRIGHTNESS 1
+#define MUZZLEY_WRITE_COLOR 2
+#define MUZZLEY_DEFAULT_NAME_WINDOW 8
+#define MUZZLEY_NAME_REPLY_TIMEOUT 10
+#define MUZZLEY_NAME_RETRY_BACKOFF 2
+#define MUZZLEY_NAME_MAX_FAILURES 5
+#define MUZZLEY_NAME_NEGATIVE_TTL 600
+#define MUZZLEY_NAME_MAX_BATCH 64
+#define MUZZLEY_HTTP_MAX_CONNECTIONS 4
+#define MUZZLEY_HTTP_IDLE_TIMEOUT 30
+#define MUZZLEY_DEFAULT_SYNC_WINDOW 250
+#define MUZZLEY_SYNC_RETRY 5000
+#define MUZZLEY_REGISTER_BACKOFF_MIN 1000
+#define MUZZLEY_REGISTER_BACKOFF_MAX 60000
+#define MUZZLEY_METER_SECONDS 120
+#define MUZZLEY_METER_MINUTES 120
+#define MUZZLEY_METER_HOURS 48
+#define MUZZLEY_METER_MIN_INTERVAL 1000
+#define MUZZLEY_METER_MAX_INTERVAL 60000
+#define MUZZLEY_METER_POWER_CHANGE 0.05
+#define MUZZLEY_METER_RECORD_INTERVAL 1
+#define MUZZLEY_DEFAULT_ENERGY_DIRECTORY "."
+#define MUZZLEY_ENERGY_INTERVAL 60
+#define MUZZLEY_ENERGY_SYNC_EVERY 60
+#define MUZZLEY_PLUG_PANEL_RETRIES 5
+#define MUZZLEY_PLUG_PANEL_RETRY_DELAY 200
+#define PLUG_SLOT_COUNT (PLUG_VALUE_COUNT + PLUG_ACTION_COUNT)
 
 
 //Mac Address
@@ -203,7 +293,6 @@ using namespace lsf;
 using namespace ajn;
 using namespace services;
 
-string muzzley_semaphore_filename="";
 string muzzley_color_mode="";
 string muzzley_core_endpointhost="";
 string muzzley_api_endpointhost="";
@@ -211,9 +300,14 @@ string muzzley_manager_endpointhost="";
 string muzzley_manager_register_url="";
 string muzzley_manager_components_url="";
 
+//Device keys are read from every thread, a new key replaces the string they point to
+typedef std::shared_ptr<const string> Muzzley_Key;
+
 string muzzley_lighting_profileid="";
 string muzzley_lighting_apptoken="";
 string muzzley_lighting_deviceKey_filename="";
+string muzzley_lighting_components_filename="";
+string muzzley_lighting_thing_filename="";
 string muzzley_lighting_upnp_friendlyname="";
 string muzzley_lighting_upnp_udn="";
 string muzzley_lighting_upnp_serialnumber="";
@@ -225,12 +319,15 @@ string muzzley_lighting_upnp_interface="";
 string muzzley_lighting_upnp_xml_filename="";
 string muzzley_lighting_sessionid="";
 string muzzley_lighting_macAddress="";
-string muzzley_lighting_deviceKey="";
+Muzzley_Key muzzley_lighting_deviceKey;
+Muzzley_Key muzzley_lighting_next_deviceKey;
 int muzzley_lighting_upnp_port=0;
 
 string muzzley_plugs_profileid="";
 string muzzley_plugs_apptoken="";
 string muzzley_plugs_deviceKey_filename="";
+string muzzley_plugs_components_filename="";
+string muzzley_plugs_thing_filename="";
 string muzzley_plugs_upnp_friendlyname="";
 string muzzley_plugs_upnp_udn="";
 string muzzley_plugs_upnp_serialnumber="";
@@ -242,7 +339,8 @@ string muzzley_plugs_upnp_interface="";
 string muzzley_plugs_upnp_xml_filename="";
 string muzzley_plugs_sessionid="";
 string muzzley_plugs_macAddress="";
-string muzzley_plugs_deviceKey="";
+Muzzley_Key muzzley_plugs_deviceKey;
+Muzzley_Key muzzley_plugs_next_deviceKey;
 int muzzley_plugs_upnp_port=0;
 
 string muzzley_network_interface="";
@@ -255,6 +353,17 @@ int muzzley_api_port=0;
 int muzzley_manager_port=0;
 bool muzzley_OnBehalfOf=true;
 
+//Current value of a device key, from any thread
+string muzzley_get_deviceKey(const Muzzley_Key& key){
+    Muzzley_Key current = std::atomic_load(&key);
+    return current ? *current : string();
+}
+
+//Replaces a device key, readers keep the value they already took
+void muzzley_set_deviceKey(Muzzley_Key& key, const string& value){
+    std::atomic_store(&key, Muzzley_Key(new string(value)));
+}
+
 
 bool muzzley_controllerclient_connected=false;
 string muzzley_controllerclient_status="";
@@ -264,8 +373,8 @@ LSFString muzzley_controllerservice_id;
 LSFString muzzley_controllerservice_name;
 
 
-bool muzzley_lighting_registered=false;
-bool muzzley_plugs_registered=false;
+std::atomic<bool> muzzley_lighting_registered(false);
+std::atomic<bool> muzzley_plugs_registered(false);
 LSFStringList lampList;
 
 AnnounceHandlerImpl* announceHandler=0;
@@ -290,19 +399,110 @@ struct Muzzley_Thing {
 Muzzley_Thing lighting_thing;
 Muzzley_Thing plugs_thing;
 
-//Component/property/CID/t/time/type
-typedef tuple <string, string, string, int, time_t, string> muzzley_req;
-vector <muzzley_req> req_vec;
+//Pending Muzzley read requests, indexed by component/property
+MuzzleyRequestTable muzzley_requests(MUZZLEY_READ_REQUEST_TIMEOUT);
+
+//Owns the connector timers
+MuzzleyScheduler muzzley_scheduler;
+
+//Controller service calls in flight, by method/lampID
+MuzzleyPendingCalls muzzley_pending_calls(LSF_LAMPSTATE_INFLIGHT_WINDOW);
+
+//Last known lamp states, answers reads while fresh
+MuzzleyLampCache muzzley_lamp_cache(MUZZLEY_DEFAULT_STATE_CACHE_TTL);
+
+//Last published lamp property values, small changes are published once they settle
+MuzzleyChangeDetector muzzley_lamp_deltas(MUZZLEY_DEFAULT_SETTLE_DELAY, muzzley_scheduler.GetDefer());
+
+//Lamp transitions, one in flight per lamp
+MuzzleyWriteCoalescer muzzley_lamp_writes(MUZZLEY_DEFAULT_WRITE_WINDOW, LSF_TRANSITION_REPLY_TIMEOUT, muzzley_scheduler.GetDefer());
+
+//Connections to the global manager and the API, reused between requests
+MuzzleyHTTPPool muzzley_http_pool(MUZZLEY_HTTP_MAX_CONNECTIONS, MUZZLEY_HTTP_IDLE_TIMEOUT);
+
+//Component adds, renames and removes, sent in batches
+MuzzleyComponentSync muzzley_lighting_sync(MUZZLEY_DEFAULT_SYNC_WINDOW, MUZZLEY_SYNC_RETRY);
+MuzzleyComponentSync muzzley_plugs_sync(MUZZLEY_DEFAULT_SYNC_WINDOW, MUZZLEY_SYNC_RETRY);
+
+//Last component sets the global manager acknowledged, by fingerprint
+MuzzleyComponentLedger muzzley_lighting_ledger;
+MuzzleyComponentLedger muzzley_plugs_ledger;
+
+//What a profile registers with, and where its registration is cached
+struct Muzzley_Registration {
+    string name;
+    string* profileid;
+    string* apptoken;
+    Muzzley_Key* deviceKey;
+    Muzzley_Key* nextDeviceKey;
+    string* deviceKey_filename;
+    string* thing_filename;
+    string* components_filename;
+    string* macAddress;
+    string* serialnumber;
+    string* friendlyname;
+    Muzzley_Thing* thing;
+    std::atomic<bool>* registered;
+    MuzzleyComponentLedger* ledger;
+    muzzley::Client* client;
+    MuzzleyPublisher* publisher;
+};
+
+Muzzley_Registration lighting_registration;
+Muzzley_Registration plugs_registration;
+
+//Registration threads, cleared and woken up on shutdown so they can be joined
+std::atomic<bool> muzzley_registering(false);
+std::mutex muzzley_registering_lock;
+std::condition_variable muzzley_registering_wakeup;
+
+//UPnP descriptions, written to disk only when they change
+MuzzleyDescription gupnp_lighting_description;
+MuzzleyDescription gupnp_plugs_description;
 
-//component/label/status/voltage/current/freq/watt/accu/GetProperties/On/Off/time
-typedef tuple <string, string, Property*, Property*, Property*, Property*, Property*, Property*, Action*, Action*, Action*, time_t> alljoyn_plug;
-vector <alljoyn_plug> plug_vec;
+//GetLampName queries, a few in flight at a time
+MuzzleyNameResolver muzzley_name_resolver(MUZZLEY_DEFAULT_NAME_WINDOW, MUZZLEY_NAME_REPLY_TIMEOUT, MUZZLEY_NAME_RETRY_BACKOFF,
+                                          MUZZLEY_NAME_MAX_FAILURES, MUZZLEY_NAME_NEGATIVE_TTL, MUZZLEY_NAME_MAX_BATCH,
+                                          muzzley_scheduler.GetDefer());
+
+//plugID/plugName/widgets/last values
+MuzzleyPlugRegistry muzzley_pluglist;
+
+//Plug readings, per second/minute/hour, a fixed number of buckets per plug
+MuzzleyMeterHistory muzzley_plug_meter(MUZZLEY_METER_SECONDS, MUZZLEY_METER_MINUTES, MUZZLEY_METER_HOURS);
+
+//Plugs are sampled faster while their power changes
+MuzzleyMeterSampler muzzley_plug_sampler(MUZZLEY_METER_MIN_INTERVAL, MUZZLEY_METER_MAX_INTERVAL, MUZZLEY_METER_POWER_CHANGE);
+
+//Plug power and energy per minute, kept on disk across restarts
+MuzzleyEnergyStore muzzley_plug_energy(MUZZLEY_DEFAULT_ENERGY_DIRECTORY, MUZZLEY_ENERGY_SYNC_EVERY);
+
+//Muzzley property of each plug value
+const char* muzzley_plug_value_property[PLUG_VALUE_COUNT] = {PROPERTY_STATUS, PROPERTY_VOLTAGE, PROPERTY_CURRENT, PROPERTY_FREQUENCY, PROPERTY_POWER, PROPERTY_ENERGY};
+
+//SmartPlug control panel labels, the status is found by position
+const char* muzzley_plug_property_label[PLUG_VALUE_COUNT] = {"", "Volt(V):", "Curr(A):", "Freq(Hz):", "Watt(W):", "ACCU(KWH):"};
+const char* muzzley_plug_action_label[PLUG_ACTION_COUNT] = {"Get Properties", "On", "Off"};
+
+//Widget layouts of the plug models seen, slots are the plug values then the plug actions
+MuzzleyWidgetLayouts muzzley_plug_layouts;
 
 //lampID/lampName
-unordered_map <string, string> muzzley_lamplist;
+MuzzleyLampRegistry muzzley_lamplist;
 
+muzzley::Client _muzzley_lighting_client;
 muzzley::Client _muzzley_plugs_client;
 
+//Replies and publishes are queued to the sender thread of their client
+MuzzleyPublisher muzzley_lighting_publisher;
+MuzzleyPublisher muzzley_plugs_publisher;
+
+MuzzleyPublisher& muzzley_get_publisher(muzzley::Client* _client){
+    if(_client == &_muzzley_plugs_client)
+        return muzzley_plugs_publisher;
+    return muzzley_lighting_publisher;
+}
+
 void lsf_controller_client_print(){
     cout << endl << "ALLJOYN LSF CONTROLLER CLIENT INFO:" << endl << flush;
     cout << "CONTROLLER CLIENT CONNECTED: " << muzzley_controllerclient_connected << endl << flush;
@@ -343,83 +543,50 @@ void alljoyn_execute_action(Action* action){
     std::cout << "Action: " << action->getWidgetName().c_str() << (status == ER_OK ? " executed successfullly" : " failed") << std::endl;
 }
 
-//Semaphore methods
-void semaphore_lock(int& semaphore) {
-    // Tests for '0' on the semaphore and increments '1' when '0' is observed
-    struct sembuf lock[2] = { { (short unsigned int) 0, 0 }, { (short unsigned int) 0, 1 } };
-    semop(semaphore, lock, 2);    
-}
-
-void semaphore_unlock(int& semaphore) {
-    // Decrements '1' on the semaphore, unblocking threads waiting for '0'
-    struct sembuf unlock[1] = { { (short unsigned int) 0, -1 } };
-    semop(semaphore, unlock, 1);    
-}
-
-int semaphore_start(){
-    key_t key = ftok(muzzley_semaphore_filename.c_str(), 1);
-    int semaphore = semget(key, 1, IPC_CREAT | 0777);
-    if (semaphore == -1)
-        cout << "Error on semaphore" << endl << flush;
-    return semaphore;
-}
-
-void semaphore_stop(int sig) {
-    //Destroy the Semaphore
-    key_t key = ftok(muzzley_semaphore_filename.c_str(), 1); // connects to the same semaphore
-    int semaphore = semget(key, 1, IPC_CREAT | 0777);
-    semctl(semaphore, 0, IPC_RMID);
-    cout << "Exiting publish semaphore..." << endl << flush;
-    
-    string s = muzzley_semaphore_filename;
-    unlink (s.c_str());
-    exit(0);
-}
-
-bool muzzley_check_semaphore_file_exists(string filename){
-    char s[200];
-    sprintf(s, "test -e %s", filename.c_str());
-    if (system(s) == 0)
-        return true;
-    else
-        return false;
-}
-
-void muzzley_write_semaphore_file(){
-    ofstream myfile;
-    myfile.open (muzzley_semaphore_filename.c_str());
-    myfile << muzzley_lighting_apptoken+muzzley_plugs_apptoken;
-    myfile.close();
-}
-
-string muzzley_read_lighting_deviceKey_file(){
+//The profile reply of the muzzley API, one key=value per line
+bool muzzley_read_thing_file(string filename, Muzzley_Thing& thing){
     ifstream myfile;
     string line;
-    myfile.open (muzzley_lighting_deviceKey_filename.c_str());
-    getline(myfile, line);
+    myfile.open (filename.c_str());
+    while(getline(myfile, line)){
+        size_t pos = line.find('=');
+        if(pos == string::npos)
+            continue;
+        string key = line.substr(0, pos);
+        string value = line.substr(pos + 1);
+        if(key == "id") thing.id = value;
+        else if(key == "uuid") thing.uuid = value;
+        else if(key == "name") thing.name = value;
+        else if(key == "kind") thing.kind = value;
+        else if(key == "provider") thing.provider = value;
+    }
     myfile.close();
-    return line;    
+    return thing.id != "";
 }
 
-void muzzley_write_lighting_deviceKey_file(string deviceKey){
+void muzzley_write_thing_file(string filename, const Muzzley_Thing& thing){
     ofstream myfile;
-    myfile.open (muzzley_lighting_deviceKey_filename.c_str());    
-    myfile << deviceKey;
+    myfile.open (filename.c_str());
+    myfile << "id=" << thing.id << endl;
+    myfile << "uuid=" << thing.uuid << endl;
+    myfile << "name=" << thing.name << endl;
+    myfile << "kind=" << thing.kind << endl;
+    myfile << "provider=" << thing.provider << endl;
     myfile.close();
 }
 
-string muzzley_read_plugs_deviceKey_file(){
+string muzzley_read_deviceKey_file(string filename){
     ifstream myfile;
     string line;
-    myfile.open (muzzley_plugs_deviceKey_filename);
+    myfile.open (filename.c_str());
     getline(myfile, line);
     myfile.close();
-    return line;    
+    return line;
 }
 
-void muzzley_write_plugs_deviceKey_file(string deviceKey){
+void muzzley_write_deviceKey_file(string filename, string deviceKey){
     ofstream myfile;
-    myfile.open (muzzley_plugs_deviceKey_filename);    
+    myfile.open (filename.c_str());
     myfile << deviceKey;
     myfile.close();
 }
@@ -433,6 +600,11 @@ double color_remap_double(double x, double in_min, double in_max, double out_min
     return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
 }
 
+//LampState fields span the whole uint32 range
+inline long long lsf_state_remap(uint32_t x, long long out_min, long long out_max){
+    return (long long)x * (out_max - out_min) / (COLOR_MAX_UINT32-1) + out_min;
+}
+
 void RGBtoHSV( double r, double g, double b, double *h, double *s, double *v )
 {
     /*
@@ -511,181 +683,12 @@ void HSVtoRGB( double *r, double *g, double *b, double h, double s, double v )
     }
 }
 
-int get_plug_vector_pos(string component){
-    try{
-        for (unsigned int i = 0; i < plug_vec.size(); i++){
-            if(get<0>(plug_vec[i])==component){
-                cout << "Plug found on pos#: " << i << endl << flush; 
-                return i;
-            }
-        }
-        cout << "Plug not found" << endl << flush; 
-        return -1;
-    }catch(exception& e){
-        cout << "Exception: " << e.what() << endl << flush;
-        return -1;
-    }
-}
-
-bool add_plug_vector_pos(string device_id_str, string device_name_str, Property* plug_property_status, Property* plug_property_volt, Property* plug_property_curr, Property* plug_property_freq, Property* plug_property_watt, Property* plug_property_accu, Action* plug_action_get_properties, Action* plug_action_on, Action* plug_action_off){
-    try{
-        time_t now = std::time(0);
-        plug_vec.push_back(make_tuple(device_id_str, device_name_str, plug_property_status, plug_property_volt, plug_property_curr, plug_property_freq, plug_property_watt , plug_property_accu, plug_action_get_properties, plug_action_on, plug_action_off, now));
-        cout << "Stored new plug info sucessfully" << endl << flush; 
-        return true;
-    }catch(exception& e){
-        cout << "Exception: " << e.what() << endl << flush;
-        return false;
-    }
-}
-
-bool del_plug_vector_pos(string component){
-    try{
-        for (unsigned int i = 0; i < plug_vec.size(); i++){
-            if(get<0>(plug_vec[i])==component){
-                plug_vec.erase(plug_vec.begin()+i);
-                cout << "Deleted plug on pos#: " << i << endl << flush; 
-                return true;
-            }
-        }
-        cout << "Plug not found" << endl << flush; 
-        return false;
-    }catch(exception& e){
-        cout << "Exception: " << e.what() << endl << flush;
-        return false;
-    }
-}
-
-string get_plug_vector_componentID(int i){
-    try{        
-        return get<0>(plug_vec[i]);
-    }catch(exception& e){
-        cout << "Exception: " << e.what() << endl << flush;
-        return "";
-    }
-}
-
-string get_plug_vector_label(int i){
-    try{        
-        cout << "Component: " << get<0>(plug_vec[i]) << endl << flush;
-        cout << "Label: " << get<1>(plug_vec[i]) << endl << flush;
-        return get<1>(plug_vec[i]);
-    }catch(exception& e){
-        cout << "Exception: " << e.what() << endl << flush;
-        return "";
-    }
-}
-
-Property* get_plug_vector_property_status(int i){
-    try{        
-        return get<2>(plug_vec[i]);
-    }catch(exception& e){
-        cout << "Exception: " << e.what() << endl << flush;
-        return NULL;
-    }
-}
-
-Property* get_plug_vector_property_voltage(int i){
-    try{        
-        return get<3>(plug_vec[i]);
-    }catch(exception& e){
-        cout << "Exception: " << e.what() << endl << flush;
-        return NULL;
-    }
-}
-
-Property* get_plug_vector_property_current(int i){
-    try{        
-        return get<4>(plug_vec[i]);
-    }catch(exception& e){
-        cout << "Exception: " << e.what() << endl << flush;
-        return NULL;
-    }
-}
-
-Property* get_plug_vector_property_frequency(int i){
-    try{
-        return get<5>(plug_vec[i]);
-    }catch(exception& e){
-        cout << "Exception: " << e.what() << endl << flush;
-        return NULL;
-    }
-}
-
-Property* get_plug_vector_property_power(int i){
-    try{
-        return get<6>(plug_vec[i]);
-    }catch(exception& e){
-        cout << "Exception: " << e.what() << endl << flush;
-        return NULL;
-    }
-}
-
-Property* get_plug_vector_property_energy(int i){
-    try{        
-        return get<7>(plug_vec[i]);
-    }catch(exception& e){
-        cout << "Exception: " << e.what() << endl << flush;
-        return NULL;
-    }
-}
-
-Action* get_plug_vector_action_getproperties(int i){
-    try{        
-        return get<8>(plug_vec[i]);
-    }catch(exception& e){
-        cout << "Exception: " << e.what() << endl << flush;
-        return NULL;
-    }
-}
-
-Action* get_plug_vector_action_set_on(int i){
-    try{        
-        return get<9>(plug_vec[i]);
-    }catch(exception& e){
-        cout << "Exception: " << e.what() << endl << flush;
-        return NULL;
-    }
-}
-
-Action* get_plug_vector_action_set_off(int i){
-    try{        
-        return get<10>(plug_vec[i]);
-    }catch(exception& e){
-        cout << "Exception: " << e.what() << endl << flush;
-        return NULL;
-    }
-}
-
-time_t get_plug_vector_time(int i){
-    try{        
-        return get<11>(plug_vec[i]);
-    }catch(exception& e){
-        cout << "Exception: " << e.what() << endl << flush;
-        return 0;
-    }
-}
-
-bool muzzley_plug_vector_check(string component){
-    try{
-        for (unsigned int i = 0; i < plug_vec.size(); i++){
-            if(strcmp(get<0>(plug_vec[i]).c_str(), component.c_str())){
-                return true;
-            }
-        }
-        return false;
-    }catch(exception& e){
-        cout << "Exception: " << e.what() << endl << flush;
-    }
-}
-
-
-void muzzley_plug_vector_print(){
+void muzzley_pluglist_print(){
     try{
         cout << endl << "PlugList:" << endl << flush;
-        for (unsigned int i = 0; i < plug_vec.size(); i++){
-            cout << endl << "Pos#: " << i+1 << "/" << plug_vec.size() << endl << flush;
-            cout << "id: " << get<0>(plug_vec[i]) << " Name: " << get<1>(plug_vec[i]) << endl << flush;
+        vector<MuzzleyPlug> plugs = muzzley_pluglist.List();
+        for (unsigned int i = 0; i < plugs.size(); i++){
+            cout << "id: " << plugs[i].id << " Name: " << plugs[i].name << endl << flush;
         }
         cout << "---END---" << endl << endl << flush;
     }catch(exception& e){
@@ -694,90 +697,31 @@ void muzzley_plug_vector_print(){
 }
 
 
-void print_request_pos(int pos){
-    double req_duration = difftime(time(0), get<4>(req_vec[pos]));
-    cout << "Request#: " << pos+1 << "/" << req_vec.size() << endl << flush;
-    cout << "Component: " << get<0>(req_vec[pos]) << endl << flush;
-    cout << "Property: " << get<1>(req_vec[pos]) << endl << flush;
-    cout << "CID: " << get<2>(req_vec[pos]) << endl << flush;
-    cout << "T: " << get<3>(req_vec[pos]) << endl << flush;
-    cout << "Time: " << get<4>(req_vec[pos]) << endl << flush;
-    cout << "Type: " << get<5>(req_vec[pos]) << endl << flush;
+void print_request(const MuzzleyRequest& request){
+    double req_duration = difftime(time(0), request.time);
+    cout << "Component: " << request.component << endl << flush;
+    cout << "Property: " << request.property << endl << flush;
+    cout << "CID: " << request.cid << endl << flush;
+    cout << "T: " << request.t << endl << flush;
+    cout << "Time: " << request.time << endl << flush;
+    cout << "Type: " << request.type << endl << flush;
     cout << "Lived: " << req_duration << " sec" << endl << endl << flush;           
 }
 
-void print_request_vector(){
+void print_request_table(){
+    vector <MuzzleyRequest> requests;
+    muzzley_requests.GetRequests(requests);
     cout << endl << "---Muzzley Read Requests:---" << endl << endl << flush;
-    for (unsigned int i = 0; i < req_vec.size(); i++){
-        print_request_pos(i);
+    for (unsigned int i = 0; i < requests.size(); i++){
+        cout << "Request#: " << i+1 << "/" << requests.size() << endl << flush;
+        print_request(requests[i]);
     }
     cout << "---END---" << endl << endl << flush;
 }
 
-int get_request_vector_size(){
-    return req_vec.size();
-}
-
-int get_request_vector_pos(string component, string property){
-    try{
-        for (unsigned int i = 0; i < req_vec.size(); i++){
-            if(!strcmp(get<0>(req_vec[i]).c_str(), component.c_str())){
-                if(!strcmp(get<1>(req_vec[i]).c_str(), property.c_str())){
-                    cout << "Muzzley pending request found on pos#: " << i << endl << flush; 
-                    return i;
-                }
-            }
-        }
-        cout << "Muzzley pending request not found" << endl << flush; 
-        return -1;
-    }catch(exception& e){
-        cout << "Exception: " << e.what() << endl << flush;
-        return -1;
-    }
-}
-
-string get_request_vector_component(int pos){
-    try{
-        return get<0>(req_vec[pos]);
-    }catch(exception& e){
-        cout << "Exception: " << e.what() << endl << flush;
-        return "";
-    }    
-}
-
-string get_request_vector_CID(int pos){
-    try{
-        return get<2>(req_vec[pos]);
-    }catch(exception& e){
-        cout << "Exception: " << e.what() << endl << flush;
-        return "";
-    }    
-}
-
-int get_request_vector_t(int pos){
+bool muzzley_add_read_request(string component, string property, string cid, int t, string type){
     try{
-        return get<3>(req_vec[pos]);
-    }catch(exception& e){
-        cout << "Exception: " << e.what() << endl << flush;
-        return -1;
-    }    
-}
-
-bool delete_request_vector_pos(int pos){
-    try{
-        req_vec.erase(req_vec.begin()+pos);
-        return true;
-    }catch(exception& e){
-        cout << "Exception: " << e.what() << endl << flush;
-        return false;
-    }    
-}
-
-bool add_request_vector_pos(string component, string property, string cid, int t, string type){
-    try{
-        time_t tm = std::time(0);
-        req_vec.push_back(make_tuple(component, property, cid, t, tm, type));
-        return true;
+        return muzzley_requests.Add(component, property, cid, t, type);
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
         return false;
@@ -786,13 +730,11 @@ bool add_request_vector_pos(string component, string property, string cid, int t
 
 bool muzzley_clean_request_component(string componentId){
     try{
-       for (unsigned int i = 0; i < req_vec.size(); i++){
-            string tmp = get_request_vector_component(i);
-            if(!strcmp(tmp.c_str(), componentId.c_str())){
-                cout << endl << "Erased muzzley read request:" << endl << flush;
-                print_request_pos(i);
-                req_vec.erase(req_vec.begin()+i); 
-            }
+        vector <MuzzleyRequest> removed;
+        muzzley_requests.RemoveComponent(componentId, removed);
+        for (unsigned int i = 0; i < removed.size(); i++){
+            cout << endl << "Erased muzzley read request:" << endl << flush;
+            print_request(removed[i]);
         }
         return true;
     }catch(exception& e){
@@ -802,15 +744,13 @@ bool muzzley_clean_request_component(string componentId){
 
 }
 
-bool muzzley_clean_request_vector(){
+bool muzzley_clean_request_table(){
     try{
-        for (unsigned int i = 0; i < req_vec.size(); i++){
-            double req_duration = difftime(time(0), get<4>(req_vec[i]));
-            if(req_duration>MUZZLEY_READ_REQUEST_TIMEOUT){
-                cout << endl << "Erased muzzley read request (timeout):" << endl << flush;
-                print_request_pos(i);
-                req_vec.erase(req_vec.begin()+i);
-            }
+        vector <MuzzleyRequest> expired;
+        muzzley_requests.Expire(time(0), expired);
+        for (unsigned int i = 0; i < expired.size(); i++){
+            cout << endl << "Erased muzzley read request (timeout):" << endl << flush;
+            print_request(expired[i]);
         }
         return true;
     }catch(exception& e){
@@ -822,21 +762,17 @@ bool muzzley_clean_request_vector(){
 
 bool muzzley_query_unknown_lampnames(LampManager* lampManager){
     try{
-        int status;
-        for ( unsigned i = 0; i < muzzley_lamplist.bucket_count(); ++i) {
-            for ( auto local_it = muzzley_lamplist.begin(i); local_it!= muzzley_lamplist.end(i); ++local_it ){
-                if(local_it->second ==  MUZZLEY_UNKNOWN_NAME){
-                    cout << endl << "Quering unknown lamp name for id: " << local_it->first << endl << flush;
-                    int semaphore = semaphore_start();
-                    semaphore_lock(semaphore);
-                    status = lampManager->GetLampName(local_it->first);
-                    semaphore_unlock(semaphore);
-                    if (status == LSF_ERR_FAILURE){
-                        return false;
-                    }
-                }
+        vector<string> unknown;
+        MuzzleyLampRegistry::Snapshot lamps = muzzley_lamplist.GetSnapshot();
+        for (MuzzleyLampRegistry::Lamps::const_iterator it = lamps->begin(); it != lamps->end(); ++it){
+            if(it->second.name ==  MUZZLEY_UNKNOWN_NAME){
+                unknown.push_back(it->first);
             }
         }
+        if(!unknown.empty()){
+            cout << endl << "Quering " << unknown.size() << " unknown lamp names" << endl << flush;
+            muzzley_name_resolver.Resolve(unknown);
+        }
         return true;
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
@@ -844,21 +780,32 @@ bool muzzley_query_unknown_lampnames(LampManager* lampManager){
     }
 }
 
+bool muzzley_update_lamplist(LampManager* lampManager){
+    //Update lampList, the names of new lamps are queried once the list arrives
+    if(!muzzley_pending_calls.Join(LSF_METHOD_GETALLLAMPIDS, "", [lampManager] (bool ok) {
+        if(ok)
+            muzzley_query_unknown_lampnames(lampManager);
+    }))
+        return true;
+
+    int status = lampManager->GetAllLampIDs();
+    if(status != LSF_OK){
+        muzzley_pending_calls.Complete(LSF_METHOD_GETALLLAMPIDS, "", false);
+        return false;
+    }
+    return true;
+}
+
 
 bool muzzley_lamplist_update_lampname(string lampID, string lampName){
     try{
-        for ( unsigned i = 0; i < muzzley_lamplist.bucket_count(); ++i) {
-        for ( auto local_it = muzzley_lamplist.begin(i); local_it!= muzzley_lamplist.end(i); ++local_it ){
-            if(local_it->first == lampID){
-                cout << endl << "Updating lamp name for id: " << local_it->first << endl << flush;
-                local_it->second=lampName;
-                return true;
-            }
+        if(muzzley_lamplist.Rename(lampID, lampName)){
+            cout << endl << "Updating lamp name for id: " << lampID << endl << flush;
+            return true;
         }
-    }
-    muzzley_lamplist[lampID] = lampName;
-    cout << endl << "Added new lamp info for id: " << lampID << endl << flush;
-    return true; 
+        muzzley_lamplist.SetName(lampID, lampName);
+        cout << endl << "Added new lamp info for id: " << lampID << endl << flush;
+        return true; 
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
         return false;
@@ -867,7 +814,7 @@ bool muzzley_lamplist_update_lampname(string lampID, string lampName){
 
 bool muzzley_lamplist_add_lamp(string lampID, string lampName){
     try{
-        muzzley_lamplist[lampID.c_str()]=lampName;
+        muzzley_lamplist.SetName(lampID, lampName);
         return true;
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
@@ -877,18 +824,10 @@ bool muzzley_lamplist_add_lamp(string lampID, string lampName){
 
 string muzzley_lamplist_get_lampname(string lampID){
     try{
-        for ( unsigned i = 0; i < muzzley_lamplist.bucket_count(); ++i) {
-            for ( auto local_it = muzzley_lamplist.begin(i); local_it!= muzzley_lamplist.end(i); ++local_it ){
-                if(local_it->first == lampID.data()){
-                    //cout << endl << "Found lamp:" << endl << flush;
-                    if(local_it->second != MUZZLEY_UNKNOWN_NAME){
-                        //cout << "id: " << local_it->first << " Name: " << local_it->second << endl << flush;
-                        return local_it->second;
-                    }
-                }
-            }
-        }
-        return MUZZLEY_UNKNOWN_NAME;
+        string lampName = muzzley_lamplist.GetName(lampID);
+        if(lampName.empty())
+            return MUZZLEY_UNKNOWN_NAME;
+        return lampName;
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
         return MUZZLEY_UNKNOWN_NAME;
@@ -898,15 +837,7 @@ string muzzley_lamplist_get_lampname(string lampID){
 
 bool muzzley_lamplist_del_lamp(string lampID){
     try{
-        for ( unsigned i = 0; i < muzzley_lamplist.bucket_count(); ++i) {
-            for ( auto local_it = muzzley_lamplist.begin(i); local_it!= muzzley_lamplist.end(i); ++local_it ){
-                if(strcmp(local_it->first.c_str(), lampID.c_str())==0){
-                    muzzley_lamplist.erase(lampID);
-                    return true;
-                }
-            }
-        }
-        return false;
+        return muzzley_lamplist.Remove(lampID);
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
         return false;
@@ -915,79 +846,32 @@ bool muzzley_lamplist_del_lamp(string lampID){
 
 bool muzzley_lamplist_del_all_lamps(){
     try{
-        for ( unsigned i = 0; i < muzzley_lamplist.bucket_count(); ++i) {
-            for ( auto local_it = muzzley_lamplist.begin(i); local_it!= muzzley_lamplist.end(i); ++local_it ){
-                if(!muzzley_lamplist_del_lamp(local_it->first)){
-                    return false;
-                }
-            }
-        }
+        muzzley_lamplist.Clear();
         return true;
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
         return false;
     }
-
 }
 
 bool muzzley_lamplist_check_lamp(string lampID){
     try{
-        for ( unsigned i = 0; i < muzzley_lamplist.bucket_count(); ++i) {
-            for ( auto local_it = muzzley_lamplist.begin(i); local_it!= muzzley_lamplist.end(i); ++local_it ){
-                if(strcmp(local_it->first.c_str(), lampID.c_str())==0){
-                    return true;
-                }
-            }
-        }
-        return false;
+        return muzzley_lamplist.Has(lampID);
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
         return false;
     }
 }
 
- bool muzzley_lamplist_replace_lamplist(const LSFStringList& lampIDs){
+bool muzzley_lamplist_replace_lamplist(const LSFStringList& lampIDs, MuzzleyLampDelta& delta){
     try{
-        LSFStringList::const_iterator it = lampIDs.begin();
-        string lampName;
-        string component;
-        bool found = false;
-        bool replace = false;
-
-        for (; it != lampIDs.end(); ++it) {
-            if(!muzzley_lamplist_check_lamp((*it).data()))
-                replace = true;
-            lampName = muzzley_lamplist_get_lampname((*it).data());
-            muzzley_lamplist_add_lamp((*it).data(), lampName);
-            cout << "Updating Lamp id: " << (*it).data() << " Name: " << lampName << endl << flush; 
-        }
-       
-        for ( unsigned i = 0; i < muzzley_lamplist.bucket_count(); ++i) {
-            for ( auto local_it = muzzley_lamplist.begin(i); local_it!= muzzley_lamplist.end(i); ++local_it ){
-                found = false;
-
-                it = lampIDs.begin();
-                component=local_it->first;
-                lampName = muzzley_lamplist_get_lampname(component);
-                for (; it != lampIDs.end(); ++it) {
-                    if(!strcmp(component.c_str(), (*it).data())){
-                        cout << "Found Lamp id: " << component << " Name: " << lampName << endl << flush;
-                        found = true;
-                    }
-                }
-
-                if(!found){
-                    lampName = muzzley_lamplist_get_lampname(component);
-                    cout << "Deleting Lamp id: " << component << " Name: " << lampName << endl << flush;
-                    muzzley_lamplist_del_lamp(component);
-                    replace = true;
-                }
-            }
-        }
+        muzzley_lamplist.Reconcile(lampIDs, MUZZLEY_UNKNOWN_NAME, delta);
+        for (unsigned int i = 0; i < delta.added.size(); i++)
+            cout << "Adding Lamp id: " << delta.added[i] << endl << flush;
+        for (unsigned int i = 0; i < delta.removed.size(); i++)
+            cout << "Deleting Lamp id: " << delta.removed[i] << endl << flush;
         cout << endl << flush;
-        if(replace)
-           return false;
-        return true;
+        return delta.added.empty() && delta.removed.empty();
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
         return false;
@@ -997,10 +881,9 @@ bool muzzley_lamplist_check_lamp(string lampID){
 void muzzley_lamplist_print(){
     try{
         cout << endl << "Lamplist: " << endl << flush;
-        for ( unsigned i = 0; i < muzzley_lamplist.bucket_count(); ++i) {
-            for ( auto local_it = muzzley_lamplist.begin(i); local_it!= muzzley_lamplist.end(i); ++local_it ){
-                cout << "id: " << local_it->first << " Name: " << local_it->second << endl << flush;
-            }
+        MuzzleyLampRegistry::Snapshot lamps = muzzley_lamplist.GetSnapshot();
+        for (MuzzleyLampRegistry::Lamps::const_iterator it = lamps->begin(); it != lamps->end(); ++it){
+            cout << "id: " << it->first << " Name: " << it->second.name << endl << flush;
         }
         cout << "---END---" << endl << endl << flush;
     }catch(exception& e){
@@ -1009,82 +892,79 @@ void muzzley_lamplist_print(){
 }
 
 void gupnp_generate_lighting_XML(){
-
-        std::stringstream responseStream;
-
-        responseStream << "<?xml version=\"1.0\"?>\n";
-        responseStream << "<root>\n";
-        responseStream << "<specVersion>\n";
-        responseStream << "<major>1</major>\n";
-        responseStream << "<minor>0</minor>\n";
-        responseStream << "</specVersion>\n";
-        responseStream << "<device>\n";
-        responseStream << "<deviceType>urn:Muzzley:device:" << muzzley_lighting_profileid << ":1</deviceType>\n";
-        responseStream << "<friendlyName>" << muzzley_lighting_upnp_friendlyname << "</friendlyName>\n";
-        responseStream << "<manufacturer>" << muzzley_manufacturer << "</manufacturer>\n";
-        responseStream << "<manufacturerURL>" << muzzley_manufacturer_url << "</manufacturerURL>\n";
-        responseStream << "<modelDescription>" << muzzley_modeldescription << "</modelDescription>\n";
-        responseStream << "<modelName>" << muzzley_modelname << "</modelName>\n";
-        responseStream << "<modelNumber>" << muzzley_modelnumber << "</modelNumber>\n";
-        responseStream << "<UDN>uuid:" << muzzley_lighting_upnp_udn << "</UDN>\n";
-        responseStream << "<serialNumber>" << muzzley_lighting_upnp_serialnumber << "</serialNumber>\n";
-        responseStream << "<macAddress>" << muzzley_lighting_macAddress << "</macAddress>\n";
-        responseStream << "<deviceKey>" << muzzley_lighting_deviceKey << "</deviceKey>\n";
-        responseStream << "<components>\n";
-            if(MUZZLEY_BRIDGE_INFO){
-                if(muzzley_controllerservice_id!=""){
-                responseStream << "<component>\n";
-                    responseStream << "<id>";
-                    responseStream << muzzley_controllerservice_id;
-                    responseStream << "</id>\n";
-
-                    responseStream << "<label>";
-                    responseStream << muzzley_controllerservice_name;
-                    responseStream << "</label>\n";
-
-                    responseStream << "<type>";
-                    responseStream << DEVICE_BRIDGE;
-                    responseStream << "</type>\n";
-                responseStream << "</component>\n";
-                }
+    try{
+        MuzzleyDescription::Fields fields;
+        fields.push_back(make_pair("deviceType", "urn:Muzzley:device:" + muzzley_lighting_profileid + ":1"));
+        fields.push_back(make_pair("friendlyName", muzzley_lighting_upnp_friendlyname));
+        fields.push_back(make_pair("manufacturer", muzzley_manufacturer));
+        fields.push_back(make_pair("manufacturerURL", muzzley_manufacturer_url));
+        fields.push_back(make_pair("modelDescription", muzzley_modeldescription));
+        fields.push_back(make_pair("modelName", muzzley_modelname));
+        fields.push_back(make_pair("modelNumber", muzzley_modelnumber));
+        fields.push_back(make_pair("UDN", "uuid:" + muzzley_lighting_upnp_udn));
+        fields.push_back(make_pair("serialNumber", muzzley_lighting_upnp_serialnumber));
+        fields.push_back(make_pair("macAddress", muzzley_lighting_macAddress));
+        fields.push_back(make_pair("deviceKey", muzzley_get_deviceKey(muzzley_lighting_deviceKey)));
+        gupnp_lighting_description.SetDevice(fields);
+
+        vector<MuzzleyDescription::Component> components;
+        if(MUZZLEY_BRIDGE_INFO){
+            if(muzzley_controllerservice_id!=""){
+                MuzzleyDescription::Component bridge = {muzzley_controllerservice_id, muzzley_controllerservice_name, DEVICE_BRIDGE};
+                components.push_back(bridge);
             }
-            
-            for ( unsigned i = 0; i < muzzley_lamplist.bucket_count(); ++i) {
-                for ( auto local_it = muzzley_lamplist.begin(i); local_it!= muzzley_lamplist.end(i); ++local_it ){
-                    responseStream << "<component>\n";
-                    responseStream << "<id>";
-                    responseStream << local_it->first;
-                    responseStream << "</id>\n";
-
-                    responseStream << "<label>";
-                    responseStream << muzzley_lamplist[local_it->first];
-                    responseStream << "</label>\n";
-
-                    responseStream << "<type>";
-                    responseStream << DEVICE_BULB;
-                    responseStream << "</type>\n";
-                    responseStream << "</component>\n";
-                }
+        }
+        MuzzleyLampRegistry::Snapshot lamps = muzzley_lamplist.GetSnapshot();
+        for (MuzzleyLampRegistry::Lamps::const_iterator it = lamps->begin(); it != lamps->end(); ++it){
+            MuzzleyDescription::Component bulb = {it->first, it->second.name, DEVICE_BULB};
+            components.push_back(bulb);
+        }
+        gupnp_lighting_description.SetComponents(components);
+
+        //Only written when the description changed
+        gupnp_lighting_description.Write(muzzley_lighting_upnp_xml_filepath + "/" + muzzley_lighting_upnp_xml_filename);
+    }catch(exception& e){
+        cout << "Exception: " << e.what() << endl << flush;
+    }
+}
+
+
+void gupnp_generate_plugs_XML(){
+    try{
+        MuzzleyDescription::Fields fields;
+        fields.push_back(make_pair("deviceType", "urn:Muzzley:device:" + muzzley_plugs_profileid + ":1"));
+        fields.push_back(make_pair("friendlyName", muzzley_plugs_upnp_friendlyname));
+        fields.push_back(make_pair("manufacturer", muzzley_manufacturer));
+        fields.push_back(make_pair("manufacturerURL", muzzley_manufacturer_url));
+        fields.push_back(make_pair("modelDescription", muzzley_modeldescription));
+        fields.push_back(make_pair("modelName", muzzley_modelname));
+        fields.push_back(make_pair("modelNumber", muzzley_modelnumber));
+        fields.push_back(make_pair("UDN", "uuid:" + muzzley_plugs_upnp_udn));
+        fields.push_back(make_pair("serialNumber", muzzley_plugs_upnp_serialnumber));
+        fields.push_back(make_pair("macAddress", muzzley_plugs_macAddress));
+        fields.push_back(make_pair("deviceKey", muzzley_get_deviceKey(muzzley_plugs_deviceKey)));
+        gupnp_plugs_description.SetDevice(fields);
+
+        vector<MuzzleyDescription::Component> components;
+        vector<MuzzleyPlug> plugs = muzzley_pluglist.List();
+        for (unsigned int i = 0; i < plugs.size(); i++){
+            if(plugs[i].id!=""){
+                MuzzleyDescription::Component plug = {plugs[i].id, plugs[i].name, DEVICE_PLUG};
+                components.push_back(plug);
             }
-        responseStream << "</components>\n";
-        responseStream << "</device>\n";
-        responseStream << "</root>\n";
+        }
+        gupnp_plugs_description.SetComponents(components);
 
-        ofstream myfile;
-        myfile.open (muzzley_lighting_upnp_xml_filepath + "/" + muzzley_lighting_upnp_xml_filename);
-        const std::string tmp = responseStream.str();
-        const char* str_xml = tmp.c_str();    
-        myfile << str_xml;
-        myfile.close();
+        //Only written when the description changed
+        gupnp_plugs_description.Write(muzzley_plugs_upnp_xml_filepath + "/" + muzzley_plugs_upnp_xml_filename);
+    }catch(exception& e){
+        cout << "Exception: " << e.what() << endl << flush;
     }
+}
 
 
 muzzley::HTTPRep muzzley_send_http_request(string host, int port, muzzley::HTTPMethod http_method, string url, string serialnumber, string deviceKey, muzzley::JSONObj _json_body_part){
     try{
-        // Instantiate an HTTP(s) socket stream
-        muzzley::socketstream _socket;
-        _socket.open(host, port); //HTTPS:443
-
         // Instantiate an HTTP request object
         muzzley::HTTPReq _req;
         _req->method(http_method);
@@ -1111,15 +991,10 @@ muzzley::HTTPRep muzzley_send_http_request(string host, int port, muzzley::HTTPM
         }   
 
         _req->body(_str_body_part);
-        _socket << _req << flush;
         cout << endl << _req << endl << endl << flush;
 
-        // Instantiate an HTTP response object
-        muzzley::HTTPRep _rep;
-        _socket >> _rep;
-        _socket.close();
-
-        return _rep;
+        // Sent on a pooled keep-alive connection
+        return muzzley_http_pool.Send(host, port, _req);
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
         muzzley::HTTPRep _rep;
@@ -1211,129 +1086,143 @@ muzzley::HTTPRep muzzley_send_globalmanager_http_request(string host, int port,
     
 }
 
-bool muzzley_replace_lighting_components(){
-
-    //Generate XML File
+//Switches a profile to a device key, on the scheduler thread
+void muzzley_use_deviceKey(Muzzley_Registration* reg, string deviceKey){
+    muzzley_set_deviceKey(*reg->deviceKey, deviceKey);
+    reg->ledger->Load(*reg->components_filename, deviceKey);
+    //The device key is part of the UPnP description
     gupnp_generate_lighting_XML();
+    gupnp_generate_plugs_XML();
+}
 
-    if(muzzley_lighting_registered==false){
-        return false;
+//Moves a profile to the device key of its last registration, when its client logs in,
+//so the subscription and the publishes change channel together
+void muzzley_login_deviceKey(Muzzley_Registration* reg){
+    Muzzley_Key next = std::atomic_exchange(reg->nextDeviceKey, Muzzley_Key());
+    if(!next){
+        return;
     }
+    //Taken right away, the subscription made on this login uses it
+    muzzley_set_deviceKey(*reg->deviceKey, *next);
+    cout << "Muzzley " << reg->name << " logged in with its new device key" << endl << flush;
+    muzzley_scheduler.Post([reg, next] () {
+        try{
+            muzzley_use_deviceKey(reg, *next);
+        }catch(exception& e){
+            cout << "Exception: " << e.what() << endl << flush;
+        }
+    });
+}
 
-
-    // set HTTP request host
-    string host = muzzley_manager_endpointhost;
-
-    // set HTTP request port
-    int port = muzzley_manager_port;
-
-    // set HTTP request method
-    muzzley::HTTPMethod http_method = muzzley::HTTPGet;
-
-    // set HTTP request server path
-    string url = muzzley_manager_components_url;
-
-    // set Header serialnumber
-    string serialNumber = muzzley_lighting_upnp_serialnumber;
-
-    // set Hearder deviceKey
-    string deviceKey = muzzley_lighting_deviceKey;
-
-
-    // set HTTP request body content
-    muzzley::JSONArr _components;
-    if(MUZZLEY_BRIDGE_INFO){
-        muzzley::JSONObj _bridge = JSON(
-            "id" << muzzley_controllerservice_id <<
-            "label" << muzzley_controllerservice_name <<
-            "type" << "bridge"
-        );
-    _components << _bridge;
-    }
-    
-    LSFStringList::const_iterator it = lampList.begin();
-    for (; it != lampList.end(); ++it) {
-        muzzley::JSONObj _bulb = JSON(
-                "id" <<  (string)(*it).data() <<
-                "label" << muzzley_lamplist[(*it).data()] <<
-                "type" << "bulb"
-            );
-            _components << _bulb;
+//Applies a registration on the scheduler thread, the muzzley client is started on the first one
+void muzzley_registered(Muzzley_Registration* reg, Muzzley_Thing thing, string deviceKey){
+    try{
+        *reg->thing = thing;
+        muzzley_write_thing_file(*reg->thing_filename, thing);
+
+        bool first = !*reg->registered;
+        bool changed = muzzley_get_deviceKey(*reg->deviceKey) != deviceKey;
+        if(changed){
+            //Store deviceKey in a file
+            muzzley_write_deviceKey_file(*reg->deviceKey_filename, deviceKey);
+        }
+        if(first){
+            muzzley_use_deviceKey(reg, deviceKey);
+        }else if(changed){
+            //The subscription is on the current key, both move on the next login
+            muzzley_set_deviceKey(*reg->nextDeviceKey, deviceKey);
+        }
+        *reg->registered = true;
+
+        if(first){
+            //Connects the application to the Muzzley server, what was queued meanwhile is sent once it is up
+            reg->client->initApp(*reg->apptoken);
+            reg->publisher->Start(reg->client);
+            cout << "Muzzley " << reg->name << " started!" << endl << flush;
+        }else if(changed){
+            cout << "Muzzley " << reg->name << " device key changed, it is used from the next login" << endl << flush;
+        }else{
+            cout << "Muzzley " << reg->name << " registration validated" << endl << flush;
+        }
+    }catch(exception& e){
+        cout << "Exception: " << e.what() << endl << flush;
     }
+}
 
-    muzzley::JSONObj _json_body_part;
-        _json_body_part <<
-            "components" << _components;
+//Registers a profile with the API and the global manager, retrying with jittered backoff
+void muzzley_register(Muzzley_Registration* reg, string deviceKey){
+    MuzzleyBackoff backoff(MUZZLEY_REGISTER_BACKOFF_MIN, MUZZLEY_REGISTER_BACKOFF_MAX);
+    while(muzzley_registering){
+        cout << endl << "Waiting for Muzzley " << reg->name << " registration..." << endl << flush;
 
+        muzzley::HTTPRep _rep = muzzley_send_api_http_request(muzzley_api_endpointhost, muzzley_api_port, *reg->profileid);
+        if (_rep->status() == muzzley::HTTP200 || _rep->status() == muzzley::HTTP201) {
+            Muzzley_Thing thing = muzzley_parse_api_http_reply(_rep);
 
-    muzzley::HTTPRep _rep = muzzley_send_http_request(host, port, http_method, url, serialNumber, deviceKey, _json_body_part);
-       
-    if (_rep->status() == muzzley::HTTP200) {}
-    else{
-        cout << "Error: " << _rep->status() << endl << flush;
-        cout << _rep->body() << endl << endl << flush;
-        return false;
+            muzzley::HTTPRep _rep = muzzley_send_globalmanager_http_request(muzzley_manager_endpointhost, muzzley_manager_port, *reg->profileid, deviceKey, *reg->macAddress, *reg->serialnumber, *reg->friendlyname);
+            if (_rep->status() == muzzley::HTTP200 || _rep->status() == muzzley::HTTP201) {
+                try{
+                    muzzley::JSONObj _key = (muzzley::JSONObj&) muzzley::fromstr(_rep->body());
+                    string newKey = (string)_key["deviceKey"];
+                    cout << endl << "Parsed Global Manager Reply:" << endl << reg->name << " deviceKey: " << newKey << endl << endl << flush;
+                    if(muzzley_registering){
+                        muzzley_scheduler.Post([reg, thing, newKey] () {
+                            muzzley_registered(reg, thing, newKey);
+                        });
+                    }
+                    return;
+                }catch(exception& e){
+                    cout << "Exception: " << e.what() << endl << flush;
+                }
+            }
+            else{
+                cout << "Error: " << _rep->status() << endl << flush;
+                cout << _rep->body() << endl << endl << flush;
+            }
+        }else{
+            cout << "Error: " << _rep->status() << endl << flush;
+            cout << _rep->body() << endl << endl << flush;
+        }
+
+        unsigned int delay = backoff.Next();
+        cout << "Retrying Muzzley " << reg->name << " registration in " << delay << " ms" << endl << flush;
+        std::unique_lock<std::mutex> guard(muzzley_registering_lock);
+        muzzley_registering_wakeup.wait_for(guard, std::chrono::milliseconds(delay), [] () -> bool {
+            return !muzzley_registering;
+        });
     }
-    return true;
 }
 
-bool muzzley_add_lighting_component(LSFString lampID, LSFString lampName){
-
-    //Generate XML File
-    gupnp_generate_lighting_XML();
-
-    if(muzzley_lighting_registered==false){
-        return false;
+//Stops the registration threads, a request in flight is waited for
+void muzzley_stop_registering(std::vector<std::thread>& threads){
+    {
+        std::lock_guard<std::mutex> guard(muzzley_registering_lock);
+        muzzley_registering = false;
+        muzzley_registering_wakeup.notify_all();
     }
-    
-    // set HTTP request host
-    string host = muzzley_manager_endpointhost;
-
-    // set HTTP request port
-    int port = muzzley_manager_port;
-
-    // set HTTP request method
-    muzzley::HTTPMethod http_method = muzzley::HTTPPut;
-
-    // set HTTP request server path
-    string url = muzzley_manager_components_url;
-
-    // set Header serialnumber
-    string serialNumber = muzzley_lighting_upnp_serialnumber;
-
-    // set Hearder deviceKey
-    string deviceKey = muzzley_lighting_deviceKey;
-
-    // set HTTP request body content
-    muzzley::JSONArr _component;
-    muzzley::JSONObj _bulb = JSON(
-        "id" <<  lampID <<
-        "label" << lampName <<
-        "type" << "bulb"
-    );
-    _component << _bulb;
-
-    muzzley::JSONObj _json_body_part;
-        _json_body_part <<
-            "components" << _component;
+    for(std::thread& thread : threads){
+        if(thread.joinable())
+            thread.join();
+    }
+    threads.clear();
+}
 
-    muzzley::HTTPRep _rep = muzzley_send_http_request(host, port, http_method, url, serialNumber, deviceKey, _json_body_part);
-    
-    if (_rep->status() == muzzley::HTTP200) {}
-    else{
-        cout << "Error: " << _rep->status() << endl << flush;
-        cout << _rep->body() << endl << endl << flush;
+//Uses the cached registration of a profile, so it starts before the server answers
+bool muzzley_load_registration(Muzzley_Registration* reg){
+    string deviceKey = muzzley_read_deviceKey_file(*reg->deviceKey_filename);
+    Muzzley_Thing thing;
+    if(deviceKey == "" || !muzzley_read_thing_file(*reg->thing_filename, thing)){
         return false;
     }
-   
+    cout << "Cached " << reg->name << " device key: " << deviceKey << endl << flush;
+    *reg->thing = thing;
+    muzzley_set_deviceKey(*reg->deviceKey, deviceKey);
+    reg->ledger->Load(*reg->components_filename, deviceKey);
+    *reg->registered = true;
     return true;
 }
 
-
-bool muzzley_add_lighting_components(LSFStringList new_lampIDs){
-
-    //Generate XML File
-    gupnp_generate_lighting_XML();
+bool muzzley_add_lighting_components(const vector<MuzzleyComponent>& new_lamps){
 
     if(muzzley_lighting_registered==false){
         return false;
@@ -1355,15 +1244,14 @@ bool muzzley_add_lighting_components(LSFStringList new_lampIDs){
     string serialNumber = muzzley_lighting_upnp_serialnumber;
 
     // set Hearder deviceKey
-    string deviceKey = muzzley_lighting_deviceKey;
+    string deviceKey = muzzley_get_deviceKey(muzzley_lighting_deviceKey);
 
     // set HTTP request body content
     muzzley::JSONArr _components;
-    LSFStringList::const_iterator it = new_lampIDs.begin();
-    for (; it != new_lampIDs.end(); ++it) {
+    for (unsigned int i = 0; i < new_lamps.size(); i++) {
         muzzley::JSONObj _bulb = JSON(
-                "id" <<  (string)(*it).data() <<
-                "label" << muzzley_lamplist[(*it).data()] <<
+                "id" <<  new_lamps[i].id <<
+                "label" << new_lamps[i].label <<
                 "type" << "bulb"
             );
             _components << _bulb;
@@ -1379,15 +1267,13 @@ bool muzzley_add_lighting_components(LSFStringList new_lampIDs){
     else{
         cout << "Error: " << _rep->status() << endl << flush;
         cout << _rep->body() << endl << endl << flush;
+        return false;
     }
     
     return true;
 }
 
-bool muzzley_remove_lighting_components(LSFStringList del_lampIDs){
-
-    //Generate XML File
-    gupnp_generate_lighting_XML();
+bool muzzley_remove_lighting_components(const vector<MuzzleyComponent>& del_lamps){
 
     if(muzzley_lighting_registered==false){
         return false;
@@ -1409,14 +1295,13 @@ bool muzzley_remove_lighting_components(LSFStringList del_lampIDs){
     string serialNumber = muzzley_lighting_upnp_serialnumber;
 
     // set Hearder deviceKey
-    string deviceKey = muzzley_lighting_deviceKey;
+    string deviceKey = muzzley_get_deviceKey(muzzley_lighting_deviceKey);
 
     // set HTTP request body content
     muzzley::JSONArr _components;
-    LSFStringList::const_iterator it = del_lampIDs.begin();
-    for (; it != del_lampIDs.end(); ++it) {
+    for (unsigned int i = 0; i < del_lamps.size(); i++) {
         muzzley::JSONObj _bulb = JSON(
-                "id" <<  (string)(*it).data()
+                "id" <<  del_lamps[i].id
             );
             _components << _bulb;
     }
@@ -1438,112 +1323,57 @@ bool muzzley_remove_lighting_components(LSFStringList del_lampIDs){
     return true;
 }
 
-void gupnp_generate_plugs_XML(){
-
-    std::stringstream responseStream;
-
-    responseStream << "<?xml version=\"1.0\"?>\n";
-    responseStream << "<root>\n";
-    responseStream << "<specVersion>\n";
-    responseStream << "<major>1</major>\n";
-    responseStream << "<minor>0</minor>\n";
-    responseStream << "</specVersion>\n";
-    responseStream << "<device>\n";
-    responseStream << "<deviceType>urn:Muzzley:device:" << muzzley_plugs_profileid << ":1</deviceType>\n";
-    responseStream << "<friendlyName>" << muzzley_plugs_upnp_friendlyname << "</friendlyName>\n";
-    responseStream << "<manufacturer>" << muzzley_manufacturer << "</manufacturer>\n";
-    responseStream << "<manufacturerURL>" << muzzley_manufacturer_url << "</manufacturerURL>\n";
-    responseStream << "<modelDescription>" << muzzley_modeldescription << "</modelDescription>\n";
-    responseStream << "<modelName>" << muzzley_modelname << "</modelName>\n";
-    responseStream << "<modelNumber>" << muzzley_modelnumber << "</modelNumber>\n";
-    responseStream << "<UDN>uuid:" << muzzley_plugs_upnp_udn << "</UDN>\n";
-    responseStream << "<serialNumber>" << muzzley_plugs_upnp_serialnumber << "</serialNumber>\n";
-    responseStream << "<macAddress>" << muzzley_plugs_macAddress << "</macAddress>\n";
-    responseStream << "<deviceKey>" << muzzley_plugs_deviceKey << "</deviceKey>\n";
-    responseStream << "<components>\n";
-    try{
-        for (unsigned int i = 0; i < plug_vec.size(); i++){
-            if(get<0>(plug_vec[i])!=""){
-                responseStream << "<component>\n";
-                responseStream << "<id>" << get<0>(plug_vec[i]) << "</id>\n";
-                responseStream << "<label>" << get<1>(plug_vec[i]) << "</label>\n";
-                responseStream << "<type>" << DEVICE_PLUG << "</type>\n";
-                responseStream << "</component>\n";
-            }
-        }
-        
-    }catch(exception& e){
-        cout << "Exception: " << e.what() << endl << flush;
-    }
-    responseStream << "</components>\n";
-    responseStream << "</device>\n";
-    responseStream << "</root>\n";
-
-    ofstream myfile;
-    myfile.open (muzzley_plugs_upnp_xml_filepath + "/" + muzzley_plugs_upnp_xml_filename);
-    const std::string tmp = responseStream.str();
-    const char* str_xml = tmp.c_str();    
-    myfile << str_xml;
-    myfile.close();
-}
-
-bool muzzley_replace_plugs_components(){
+//Sends a batch of lighting component changes, called by the lighting component sync
+bool muzzley_sync_lighting_components(const vector<MuzzleyComponent>& upserts, const vector<MuzzleyComponent>& removes){
 
     //Generate XML File
-    gupnp_generate_plugs_XML();
+    gupnp_generate_lighting_XML();
 
-    if(muzzley_plugs_registered==false){
-        return false;
+    //Skip what the manager already acknowledged
+    vector<MuzzleyComponent> changed_upserts(upserts);
+    vector<MuzzleyComponent> changed_removes(removes);
+    if(!muzzley_lighting_ledger.Filter(changed_upserts, changed_removes)){
+        return true;
     }
 
-    // set HTTP request host
-    string host = muzzley_manager_endpointhost;
-
-    // set HTTP request port
-    int port = muzzley_manager_port;
-
-    // set HTTP request method
-    muzzley::HTTPMethod http_method = muzzley::HTTPPost;
-
-    // set HTTP request server path
-    string url = muzzley_manager_components_url;
-
-    // set Header serialnumber
-    string serialNumber = muzzley_plugs_upnp_serialnumber;
-
-    // set Hearder deviceKey
-    string deviceKey = muzzley_plugs_deviceKey;
-
-    // set HTTP request body content
-    muzzley::JSONArr _components;
-    for (unsigned int i = 0; i < plug_vec.size(); i++){
-        muzzley::JSONObj _bulb = JSON(
-            "id" <<  get<0>(plug_vec[i]) <<
-            "label" << get<1>(plug_vec[i]) <<
-            "type" << DEVICE_PLUG
-        );
-        _components << _bulb;
+    bool ok = true;
+    if(!changed_removes.empty()){
+        ok = muzzley_remove_lighting_components(changed_removes) && ok;
     }
+    if(ok && !changed_upserts.empty()){
+        ok = muzzley_add_lighting_components(changed_upserts) && ok;
+    }
+    if(ok){
+        muzzley_lighting_ledger.Commit(changed_upserts, changed_removes);
+    }
+    return ok;
+}
 
-    muzzley::JSONObj _json_body_part;
-        _json_body_part <<
-            "components" << _components;
-
-
-    muzzley::HTTPRep _rep = muzzley_send_http_request(host, port, http_method, url, serialNumber, deviceKey, _json_body_part);
+//Queues only the lamps that were added or removed
+void muzzley_apply_lighting_delta(const MuzzleyLampDelta& delta){
+    for (unsigned int i = 0; i < delta.removed.size(); i++){
+        muzzley_lamp_cache.Remove(delta.removed[i]);
+        muzzley_lamp_deltas.Forget(delta.removed[i]);
+        muzzley_lamp_writes.Forget(delta.removed[i]);
+        muzzley_name_resolver.Forget(delta.removed[i]);
+        muzzley_lighting_sync.Remove(delta.removed[i]);
+    }
+    for (unsigned int i = 0; i < delta.added.size(); i++){
+        muzzley_lighting_sync.Add(delta.added[i], muzzley_lamplist.GetName(delta.added[i]));
+    }
+}
 
-    if (_rep->status() == muzzley::HTTP200) {}
-    else{
-        cout << "Error: " << _rep->status() << endl << flush;
-        cout << _rep->body() << endl << endl << flush;
-        return false;
+//Renames a batch of resolved lamps
+void muzzley_apply_lighting_names(const vector<pair<string, string> >& names){
+    for (unsigned int i = 0; i < names.size(); i++){
+        if(muzzley_lamplist.Rename(names[i].first, names[i].second)){
+            cout << endl << "Lamp ID: " << names[i].first << endl << "Name: " << names[i].second << " was updated in lamplist" << endl << flush;
+            muzzley_lighting_sync.Add(names[i].first, names[i].second);
+        }
     }
-    return true;
 }
-bool muzzley_add_plugs_component(string plug_id, string plug_name){
 
-    //Generate XML File
-    gupnp_generate_plugs_XML();
+bool muzzley_add_plugs_components(const vector<MuzzleyComponent>& new_plugs){
 
     if(muzzley_plugs_registered==false){
         return false;
@@ -1565,24 +1395,26 @@ bool muzzley_add_plugs_component(string plug_id, string plug_name){
     string serialNumber = muzzley_plugs_upnp_serialnumber;
 
     // set Hearder deviceKey
-    string deviceKey = muzzley_plugs_deviceKey;
+    string deviceKey = muzzley_get_deviceKey(muzzley_plugs_deviceKey);
 
     // set HTTP request body content
-    muzzley::JSONArr _component;
-    muzzley::JSONObj _plug = JSON(
-        "id" <<  plug_id <<
-        "label" << plug_name <<
-        "type" << DEVICE_PLUG
-    );
-    _component << _plug;
+    muzzley::JSONArr _components;
+    for (unsigned int i = 0; i < new_plugs.size(); i++){
+        muzzley::JSONObj _plug = JSON(
+            "id" <<  new_plugs[i].id <<
+            "label" << new_plugs[i].label <<
+            "type" << DEVICE_PLUG
+        );
+        _components << _plug;
+    }
 
     muzzley::JSONObj _json_body_part;
         _json_body_part <<
-            "components" << _component;
+            "components" << _components;
 
 
     muzzley::HTTPRep _rep = muzzley_send_http_request(host, port, http_method, url, serialNumber, deviceKey, _json_body_part);
-
+        
     if (_rep->status() == muzzley::HTTP200) {}
     else{
         cout << "Error: " << _rep->status() << endl << flush;
@@ -1593,10 +1425,7 @@ bool muzzley_add_plugs_component(string plug_id, string plug_name){
     return true;
 }
 
-bool muzzley_add_plugs_components(string plug_id, string plug_name){
-
-    //Generate XML File
-    gupnp_generate_plugs_XML();
+bool muzzley_remove_plugs_components(const vector<MuzzleyComponent>& del_plugs){
 
     if(muzzley_plugs_registered==false){
         return false;
@@ -1609,7 +1438,7 @@ bool muzzley_add_plugs_components(string plug_id, string plug_name){
     int port = muzzley_manager_port;
 
     // set HTTP request method
-    muzzley::HTTPMethod http_method = muzzley::HTTPPut;
+    muzzley::HTTPMethod http_method = muzzley::HTTPDelete;
 
     // set HTTP request server path
     string url = muzzley_manager_components_url;
@@ -1618,16 +1447,18 @@ bool muzzley_add_plugs_components(string plug_id, string plug_name){
     string serialNumber = muzzley_plugs_upnp_serialnumber;
 
     // set Hearder deviceKey
-    string deviceKey = muzzley_plugs_deviceKey;
+    string deviceKey = muzzley_get_deviceKey(muzzley_plugs_deviceKey);
 
     // set HTTP request body content
     muzzley::JSONArr _components;
-    muzzley::JSONObj _plug = JSON(
-        "id" <<  plug_id <<
-        "label" << plug_name <<
-        "type" << DEVICE_PLUG
-    );
-    _components << _plug;
+    for (unsigned int i = 0; i < del_plugs.size(); i++){
+        muzzley::JSONObj _plug = JSON(
+            "id" <<  del_plugs[i].id <<
+            "label" << del_plugs[i].label <<
+            "type" << DEVICE_PLUG
+        );
+        _components << _plug;
+    }
 
     muzzley::JSONObj _json_body_part;
         _json_body_part <<
@@ -1635,73 +1466,48 @@ bool muzzley_add_plugs_components(string plug_id, string plug_name){
 
 
     muzzley::HTTPRep _rep = muzzley_send_http_request(host, port, http_method, url, serialNumber, deviceKey, _json_body_part);
-        
+    
     if (_rep->status() == muzzley::HTTP200) {}
     else{
         cout << "Error: " << _rep->status() << endl << flush;
         cout << _rep->body() << endl << endl << flush;
         return false;
     }
-
     return true;
 }
 
-bool muzzley_remove_plugs_component(string plug_id, string plug_name){
+//Sends a batch of plug component changes, called by the plugs component sync
+bool muzzley_sync_plugs_components(const vector<MuzzleyComponent>& upserts, const vector<MuzzleyComponent>& removes){
 
     //Generate XML File
     gupnp_generate_plugs_XML();
 
-    if(muzzley_lighting_registered==false){
-        return false;
+    //Skip what the manager already acknowledged
+    vector<MuzzleyComponent> changed_upserts(upserts);
+    vector<MuzzleyComponent> changed_removes(removes);
+    if(!muzzley_plugs_ledger.Filter(changed_upserts, changed_removes)){
+        return true;
     }
 
-    // set HTTP request host
-    string host = muzzley_manager_endpointhost;
-
-    // set HTTP request port
-    int port = muzzley_manager_port;
-
-    // set HTTP request method
-    muzzley::HTTPMethod http_method = muzzley::HTTPDelete;
-
-    // set HTTP request server path
-    string url = muzzley_manager_components_url;
-
-    // set Header serialnumber
-    string serialNumber = muzzley_plugs_upnp_serialnumber;
-
-    // set Hearder deviceKey
-    string deviceKey = muzzley_plugs_deviceKey;
-
-    // set HTTP request body content
-    muzzley::JSONArr _components;
-    muzzley::JSONObj _plug = JSON(
-        "id" <<  plug_id <<
-        "label" << plug_name <<
-        "type" << DEVICE_PLUG
-    );
-    _components << _plug;
-
-    muzzley::JSONObj _json_body_part;
-        _json_body_part <<
-            "components" << _components;
-
-
-    muzzley::HTTPRep _rep = muzzley_send_http_request(host, port, http_method, url, serialNumber, deviceKey, _json_body_part);
-    
-    if (_rep->status() == muzzley::HTTP200) {}
-    else{
-        cout << "Error: " << _rep->status() << endl << flush;
-        cout << _rep->body() << endl << endl << flush;
-        return false;
+    bool ok = true;
+    if(!changed_removes.empty()){
+        ok = muzzley_remove_plugs_components(changed_removes) && ok;
     }
-    return true;
+    if(ok && !changed_upserts.empty()){
+        ok = muzzley_add_plugs_components(changed_upserts) && ok;
+    }
+    if(ok){
+        muzzley_plugs_ledger.Commit(changed_upserts, changed_removes);
+    }
+    return ok;
 }
 
 bool muzzley_publish(string workspace, string profileId, string channelId, string componentId, string property, muzzley::JSONObj data, muzzley::Client* _client){
     try{
-        
-        int semaphore = semaphore_start();
+        //Nothing is queued before the profile has a channel
+        if(channelId == ""){
+            return false;
+        }
 
         muzzley::Subscription _s1;
         _s1.setNamespace(workspace);
@@ -1711,13 +1517,13 @@ bool muzzley_publish(string workspace, string profileId, string channelId, strin
         _s1.setProperty(property);
 
         muzzley::Message _m1;
-        int pos = get_request_vector_pos(componentId, property);
+        vector <MuzzleyRequest> requests;
+        muzzley_requests.Take(componentId, property, requests);
 
-        
-        while(pos!=-1){
+        for (unsigned int i = 0; i < requests.size(); i++){
             _m1.setStatus(true);
-            _m1.setCorrelationID(get_request_vector_CID(pos));
-            _m1.setMessageType((muzzley::MessageType)get_request_vector_t(pos));
+            _m1.setCorrelationID(requests[i].cid);
+            _m1.setMessageType((muzzley::MessageType)requests[i].t);
             _m1.setData(JSON(
                "value" <<  data <<
                "profile" << profileId <<
@@ -1731,14 +1537,10 @@ bool muzzley_publish(string workspace, string profileId, string channelId, strin
 
             //cout << _s1 << endl << flush;
             //cout << _m1 << endl << flush;
-            semaphore_lock(semaphore);
-            _client->reply(_m1, _m1);
-            semaphore_unlock(semaphore);
-            delete_request_vector_pos(pos);
-            pos = get_request_vector_pos(componentId, property);
-            if(pos==-1)
-                return true;
+            muzzley_get_publisher(_client).Reply(_m1);
         }
+        if(requests.size()>0)
+            return true;
     
         _m1.setData(JSON(
             "io" << "i" <<
@@ -1749,9 +1551,7 @@ bool muzzley_publish(string workspace, string profileId, string channelId, strin
 
         //cout << _s1 << endl << flush;
         //cout << _m1 << endl << flush;
-        semaphore_lock(semaphore);
-        _client->trigger(muzzley::Publish, _s1, _m1);
-        semaphore_unlock(semaphore);
+        muzzley_get_publisher(_client).Publish(_s1, _m1, channelId, componentId, property, JSON("value" << data));
         return true;
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
@@ -1761,9 +1561,6 @@ bool muzzley_publish(string workspace, string profileId, string channelId, strin
 
 bool muzzley_publish(string workspace, string profileId, string channelId, string componentId, string property, string data, muzzley::Client* _client){
     try{
-        
-        int semaphore = semaphore_start();
-
         muzzley::Subscription _s1;
         _s1.setNamespace(workspace);
         _s1.setProfile(profileId);
@@ -1772,13 +1569,13 @@ bool muzzley_publish(string workspace, string profileId, string channelId, strin
         _s1.setProperty(property);
 
         muzzley::Message _m1;
-        int pos = get_request_vector_pos(componentId, property);
+        vector <MuzzleyRequest> requests;
+        muzzley_requests.Take(componentId, property, requests);
 
-        
-        while(pos!=-1){
+        for (unsigned int i = 0; i < requests.size(); i++){
             _m1.setStatus(true);
-            _m1.setCorrelationID(get_request_vector_CID(pos));
-            _m1.setMessageType((muzzley::MessageType)get_request_vector_t(pos));
+            _m1.setCorrelationID(requests[i].cid);
+            _m1.setMessageType((muzzley::MessageType)requests[i].t);
             _m1.setData(JSON(
                "value" <<  data <<
                "profile" << profileId <<
@@ -1792,14 +1589,10 @@ bool muzzley_publish(string workspace, string profileId, string channelId, strin
 
             //cout << _s1 << endl << flush;
             //cout << _m1 << endl << flush;
-            semaphore_lock(semaphore);
-            _client->reply(_m1, _m1);
-            semaphore_unlock(semaphore);
-            delete_request_vector_pos(pos);
-            pos = get_request_vector_pos(componentId, property);
-            if(pos==-1)
-                return true;
+            muzzley_get_publisher(_client).Reply(_m1);
         }
+        if(requests.size()>0)
+            return true;
     
         _m1.setData(JSON(
             "io" << "i" <<
@@ -1810,9 +1603,7 @@ bool muzzley_publish(string workspace, string profileId, string channelId, strin
 
         //cout << _s1 << endl << flush;
         //cout << _m1 << endl << flush;
-        semaphore_lock(semaphore);
-        _client->trigger(muzzley::Publish, _s1, _m1);
-        semaphore_unlock(semaphore);
+        muzzley_get_publisher(_client).Publish(_s1, _m1, channelId, componentId, property, JSON("value" << data));
         return true;
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
@@ -1822,9 +1613,6 @@ bool muzzley_publish(string workspace, string profileId, string channelId, strin
 
 bool muzzley_publish(string workspace, string profileId, string channelId, string componentId, string property, double data, muzzley::Client* _client){
     try{
-        
-        int semaphore = semaphore_start();
-
         muzzley::Subscription _s1;
         _s1.setNamespace(workspace);
         _s1.setProfile(profileId);
@@ -1833,13 +1621,13 @@ bool muzzley_publish(string workspace, string profileId, string channelId, strin
         _s1.setProperty(property);
 
         muzzley::Message _m1;
-        int pos = get_request_vector_pos(componentId, property);
+        vector <MuzzleyRequest> requests;
+        muzzley_requests.Take(componentId, property, requests);
 
-        
-        while(pos!=-1){
+        for (unsigned int i = 0; i < requests.size(); i++){
             _m1.setStatus(true);
-            _m1.setCorrelationID(get_request_vector_CID(pos));
-            _m1.setMessageType((muzzley::MessageType)get_request_vector_t(pos));
+            _m1.setCorrelationID(requests[i].cid);
+            _m1.setMessageType((muzzley::MessageType)requests[i].t);
             _m1.setData(JSON(
                "value" <<  data <<
                "profile" << profileId <<
@@ -1853,14 +1641,10 @@ bool muzzley_publish(string workspace, string profileId, string channelId, strin
 
             //cout << _s1 << endl << flush;
             //cout << _m1 << endl << flush;
-            semaphore_lock(semaphore);
-            _client->reply(_m1, _m1);
-            semaphore_unlock(semaphore);
-            delete_request_vector_pos(pos);
-            pos = get_request_vector_pos(componentId, property);
-            if(pos==-1)
-                return true;
+            muzzley_get_publisher(_client).Reply(_m1);
         }
+        if(requests.size()>0)
+            return true;
     
         _m1.setData(JSON(
             "io" << "i" <<
@@ -1871,9 +1655,7 @@ bool muzzley_publish(string workspace, string profileId, string channelId, strin
 
         //cout << _s1 << endl << flush;
         //cout << _m1 << endl << flush;
-        semaphore_lock(semaphore);
-        _client->trigger(muzzley::Publish, _s1, _m1);
-        semaphore_unlock(semaphore);
+        muzzley_get_publisher(_client).Publish(_s1, _m1, channelId, componentId, property, JSON("value" << data));
         return true;
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
@@ -1885,9 +1667,6 @@ bool muzzley_publish(string workspace, string profileId, string channelId, strin
 
 bool muzzley_publish(string workspace, string profileId, string channelId, string componentId, string property, bool data, muzzley::Client* _client){
     try{
-        
-        int semaphore = semaphore_start();
-
         muzzley::Subscription _s1;
         _s1.setNamespace(workspace);
         _s1.setProfile(profileId);
@@ -1896,13 +1675,13 @@ bool muzzley_publish(string workspace, string profileId, string channelId, strin
         _s1.setProperty(property);
 
         muzzley::Message _m1;
-        int pos = get_request_vector_pos(componentId, property);
+        vector <MuzzleyRequest> requests;
+        muzzley_requests.Take(componentId, property, requests);
 
-        
-        while(pos!=-1){
+        for (unsigned int i = 0; i < requests.size(); i++){
             _m1.setStatus(true);
-            _m1.setCorrelationID(get_request_vector_CID(pos));
-            _m1.setMessageType((muzzley::MessageType)get_request_vector_t(pos));
+            _m1.setCorrelationID(requests[i].cid);
+            _m1.setMessageType((muzzley::MessageType)requests[i].t);
             _m1.setData(JSON(
                "value" <<  data <<
                "profile" << profileId <<
@@ -1916,14 +1695,10 @@ bool muzzley_publish(string workspace, string profileId, string channelId, strin
 
             //cout << _s1 << endl << flush;
             //cout << _m1 << endl << flush;
-            semaphore_lock(semaphore);
-            _client->reply(_m1, _m1);
-            semaphore_unlock(semaphore);
-            delete_request_vector_pos(pos);
-            pos = get_request_vector_pos(componentId, property);
-            if(pos==-1)
-                return true;
+            muzzley_get_publisher(_client).Reply(_m1);
         }
+        if(requests.size()>0)
+            return true;
     
         _m1.setData(JSON(
             "io" << "i" <<
@@ -1934,9 +1709,7 @@ bool muzzley_publish(string workspace, string profileId, string channelId, strin
 
         //cout << _s1 << endl << flush;
         //cout << _m1 << endl << flush;
-        semaphore_lock(semaphore);
-        _client->trigger(muzzley::Publish, _s1, _m1);
-        semaphore_unlock(semaphore);
+        muzzley_get_publisher(_client).Publish(_s1, _m1, channelId, componentId, property, JSON("value" << data));
         return true;
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
@@ -1947,7 +1720,7 @@ bool muzzley_publish(string workspace, string profileId, string channelId, strin
 
 bool muzzley_publish_lampReachable(LSFString lampID, bool reachable, muzzley::Client* _muzzley_lighting_client){
     try{ 
-        return muzzley_publish(MUZZLEY_WORKSPACE, muzzley_lighting_profileid, muzzley_lighting_deviceKey, lampID, PROPERTY_REACHABLE, reachable, _muzzley_lighting_client);
+        return muzzley_publish(MUZZLEY_WORKSPACE, muzzley_lighting_profileid, muzzley_get_deviceKey(muzzley_lighting_deviceKey), lampID, PROPERTY_REACHABLE, reachable, _muzzley_lighting_client);
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
         return false;
@@ -1956,7 +1729,7 @@ bool muzzley_publish_lampReachable(LSFString lampID, bool reachable, muzzley::Cl
 
 bool muzzley_publish_lampState(LSFString lampID, bool onoff, muzzley::Client* _muzzley_lighting_client){
     try{
-        return muzzley_publish(MUZZLEY_WORKSPACE, muzzley_lighting_profileid, muzzley_lighting_deviceKey, lampID, PROPERTY_STATUS, onoff, _muzzley_lighting_client);
+        return muzzley_publish(MUZZLEY_WORKSPACE, muzzley_lighting_profileid, muzzley_get_deviceKey(muzzley_lighting_deviceKey), lampID, PROPERTY_STATUS, onoff, _muzzley_lighting_client);
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
         return false;
@@ -1966,7 +1739,7 @@ bool muzzley_publish_lampState(LSFString lampID, bool onoff, muzzley::Client* _m
 
 bool muzzley_publish_brightness(LSFString lampID, double brightness, muzzley::Client* _muzzley_lighting_client){
     try{
-        return muzzley_publish(MUZZLEY_WORKSPACE, muzzley_lighting_profileid, muzzley_lighting_deviceKey, lampID, PROPERTY_BRIGHTNESS, brightness, _muzzley_lighting_client);
+        return muzzley_publish(MUZZLEY_WORKSPACE, muzzley_lighting_profileid, muzzley_get_deviceKey(muzzley_lighting_deviceKey), lampID, PROPERTY_BRIGHTNESS, brightness, _muzzley_lighting_client);
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
         return false;
@@ -1978,7 +1751,7 @@ bool muzzley_publish_brightness(LSFString lampID, double brightness, muzzley::Cl
 bool muzzley_publish_lampColor_rgb(LSFString lampID, int red, int green, int blue, muzzley::Client* _muzzley_lighting_client){
     try{
         muzzley::JSONObj rgb = JSON("r" << red << "g" << green << "b" << blue);
-        return muzzley_publish(MUZZLEY_WORKSPACE, muzzley_lighting_profileid, muzzley_lighting_deviceKey, lampID, PROPERTY_COLOR_RGB, rgb, _muzzley_lighting_client);
+        return muzzley_publish(MUZZLEY_WORKSPACE, muzzley_lighting_profileid, muzzley_get_deviceKey(muzzley_lighting_deviceKey), lampID, PROPERTY_COLOR_RGB, rgb, _muzzley_lighting_client);
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
         return false;
@@ -1988,7 +1761,7 @@ bool muzzley_publish_lampColor_rgb(LSFString lampID, int red, int green, int blu
 bool muzzley_publish_lampColor_hsv(LSFString lampID, int hue, int saturation, int value, muzzley::Client* _muzzley_lighting_client){
     try{
         muzzley::JSONObj hsv = JSON("h" << hue << "s" << saturation << "v" << value);
-        return muzzley_publish(MUZZLEY_WORKSPACE, muzzley_lighting_profileid, muzzley_lighting_deviceKey, lampID, PROPERTY_COLOR_HSV, hsv, _muzzley_lighting_client);
+        return muzzley_publish(MUZZLEY_WORKSPACE, muzzley_lighting_profileid, muzzley_get_deviceKey(muzzley_lighting_deviceKey), lampID, PROPERTY_COLOR_HSV, hsv, _muzzley_lighting_client);
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
         return false;
@@ -1998,107 +1771,96 @@ bool muzzley_publish_lampColor_hsv(LSFString lampID, int hue, int saturation, in
 bool muzzley_publish_lampColor_hsvt(LSFString lampID, int hue, int saturation, int value, int temperature, muzzley::Client* _muzzley_lighting_client){
     try{
         muzzley::JSONObj hsvt = JSON("h" << hue << "s" << saturation << "v" << value << "t" << temperature);
-        return muzzley_publish(MUZZLEY_WORKSPACE, muzzley_lighting_profileid, muzzley_lighting_deviceKey, lampID, PROPERTY_COLOR_HSVT, hsvt, _muzzley_lighting_client);
+        return muzzley_publish(MUZZLEY_WORKSPACE, muzzley_lighting_profileid, muzzley_get_deviceKey(muzzley_lighting_deviceKey), lampID, PROPERTY_COLOR_HSVT, hsvt, _muzzley_lighting_client);
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
         return false;
-    }
+    }
+}
+
+//Publish a lamp property value held back by its threshold, once no newer value came
+void muzzley_publish_lamp_settled(const string& lampID, const string& lampProperty, const double* fields, unsigned int count){
+    if(lampProperty == PROPERTY_BRIGHTNESS && count == 1){
+        muzzley_publish_brightness(lampID.c_str(), fields[0], &_muzzley_lighting_client);
+    }else if(lampProperty == PROPERTY_COLOR_HSV && count == 3){
+        muzzley_publish_lampColor_hsv(lampID.c_str(), (int)fields[0], (int)fields[1], (int)fields[2], &_muzzley_lighting_client);
+    }else if(lampProperty == PROPERTY_COLOR_HSVT && count == 4){
+        muzzley_publish_lampColor_hsvt(lampID.c_str(), (int)fields[0], (int)fields[1], (int)fields[2], (int)fields[3], &_muzzley_lighting_client);
+    }else if(lampProperty == PROPERTY_COLOR_RGB && count == 3){
+        muzzley_publish_lampColor_rgb(lampID.c_str(), (int)fields[0], (int)fields[1], (int)fields[2], &_muzzley_lighting_client);
+    }
+}
+
+//Check if a lamp property must be published: it was read, or it is an event property that changed enough since it was last published
+bool muzzley_lamp_property_due(const LSFString& lampID, const string& lampProperty, const string& property, bool event, const double* fields, unsigned int count){
+    if(property == lampProperty || muzzley_requests.Has(lampID, lampProperty))
+        return true;
+    if(!property.empty() || !event)
+        return false;
+    return muzzley_lamp_deltas.Changed(lampID, lampProperty, fields, count);
 }
 
-bool muzzley_parseLampState(LSFString lampID, LampState lampState, muzzley::Client* _muzzley_lighting_client){
+//Publish the changed lamp properties, or only the given property when answering a read
+bool muzzley_parseLampState(const LSFString& lampID, const LampState& lampState, muzzley::Client* _muzzley_lighting_client, const string& property=""){
 
     try{
-        std::string line, onoff, hue, saturation, brightness, colortemp;
-        std::string input = lampState.c_str();
-        std::string delimiter = "=";
-        std::stringstream ss(input);
-
-        while(std::getline(ss, line))
-        {
-            std::string key = line.substr(0, line.find(delimiter));
-            std::string value = line.substr(line.find(delimiter)+1);
-            if(key == "OnOff") {
-                onoff = value;
-            } else if(key == "Brightness") {
-                brightness = value; 
-            } else if(key == "Hue") {
-                hue = value;
-            } else if(key == "Saturation") {
-                saturation = value;
-            } else if(key == "ColorTemp") {
-                colortemp = value;
-            }
+        //Only the configured color representation is published as an event
+        bool hsv_mode  = strcmp(muzzley_color_mode.c_str(), PROPERTY_COLOR_HSV)==0;
+        bool hsvt_mode = strcmp(muzzley_color_mode.c_str(), PROPERTY_COLOR_HSVT)==0;
+        bool rgb_mode  = strcmp(muzzley_color_mode.c_str(), PROPERTY_COLOR_RGB)==0;
+
+        //Property names are built once, the detector and request table take strings
+        static const string reachable_property(PROPERTY_REACHABLE);
+        static const string hsv_property(PROPERTY_COLOR_HSV);
+        static const string hsvt_property(PROPERTY_COLOR_HSVT);
+        static const string status_property(PROPERTY_STATUS);
+        static const string brightness_property(PROPERTY_BRIGHTNESS);
+        static const string rgb_property(PROPERTY_COLOR_RGB);
+
+        bool onoff_state   = lampState.onOff;
+        int brightness_int = (int)lsf_state_remap(lampState.brightness, COLOR_MIN,                 COLOR_MAX_PERCENT);
+        int hue_int        = (int)lsf_state_remap(lampState.hue,        COLOR_MIN,                 COLOR_MAX_360DEG);
+        int saturation_int = (int)lsf_state_remap(lampState.saturation, COLOR_MIN,                 COLOR_MAX_PERCENT);
+        int colortemp_int  = (int)lsf_state_remap(lampState.colorTemp,  COLOR_TEMPERATURE_MIN_DEC, COLOR_TEMPERATURE_MAX_DEC);
+
+        double reachable_field = 1;
+        if(muzzley_lamp_property_due(lampID, reachable_property, property, true, &reachable_field, 1)){
+            muzzley_publish_lampReachable(lampID, true, _muzzley_lighting_client);
         }
-        
-        bool onoff_state = (bool) atoi(onoff.data());
-        long long long_brightness = atoll (brightness.data());
-        long long long_hue = atoll (hue.data());
-        long long long_saturation = atoll (saturation.data());
-        long long long_colortemp = atoll (colortemp.data());
-
-        long long brightness_int = color_remap_long_long(long_brightness, COLOR_MIN, (COLOR_MAX_UINT32-1), COLOR_MIN,                 COLOR_MAX_PERCENT);
-        long long hue_int        = color_remap_long_long(long_hue,        COLOR_MIN, (COLOR_MAX_UINT32-1), COLOR_MIN,                 COLOR_MAX_360DEG);
-        long long saturation_int = color_remap_long_long(long_saturation, COLOR_MIN, (COLOR_MAX_UINT32-1), COLOR_MIN,                 COLOR_MAX_PERCENT);
-        long long colortemp_int  = color_remap_long_long(long_colortemp,  COLOR_MIN, (COLOR_MAX_UINT32-1), COLOR_TEMPERATURE_MIN_DEC, COLOR_TEMPERATURE_MAX_DEC);
-
-        
-        muzzley_publish_lampReachable(lampID, true, _muzzley_lighting_client);
           
-        if(strcmp(muzzley_color_mode.c_str(), PROPERTY_COLOR_HSV)==0){
+        //Reads for the other color representations are answered from the same state
+        double hsvt_fields[] = {(double)hue_int, (double)saturation_int, (double)brightness_int, (double)colortemp_int};
+        if(muzzley_lamp_property_due(lampID, hsv_property, property, hsv_mode, hsvt_fields, 3)){
         	muzzley_publish_lampColor_hsv(lampID, hue_int, saturation_int, brightness_int, _muzzley_lighting_client);
         }
         
-        if(strcmp(muzzley_color_mode.c_str(), PROPERTY_COLOR_HSVT)==0){
+        if(muzzley_lamp_property_due(lampID, hsvt_property, property, hsvt_mode, hsvt_fields, 4)){
         	muzzley_publish_lampColor_hsvt(lampID, hue_int, saturation_int, brightness_int, colortemp_int, _muzzley_lighting_client);
         }
 
-        std::cout <<  "\n{\"onOff\": " << onoff << "," << std::endl;
-        std::cout <<  "\"brightness\": " << brightness << "," << std::endl;
-        std::cout <<  "\"hue\": " << hue << "," << std::endl;
-        std::cout <<  "\"saturation\": " << saturation << "," << std::endl;
-        std::cout <<  "\"colorTemp\": " << colortemp << "}" << std::endl;
-
-        printf("\nonOff: %s\n", (onoff_state)?"true":"false");
-        printf("brightness: %lld\n", long_brightness);
-        printf("hue: %lld\n", long_hue);
-        printf("saturation: %lld\n", long_saturation);
-        printf("colorTemp: %lld\n", long_colortemp);
-        printf("Brightness: %lld\n", brightness_int);
-        printf("Hue: %lld\n", hue_int);
-        printf("Saturation: %lld\n", saturation_int);
-        printf("ColorTemp: %lld\n\n", colortemp_int);
-
-
-        muzzley_publish_lampState(lampID, onoff_state, _muzzley_lighting_client);
+        double status_field = onoff_state;
+        if(muzzley_lamp_property_due(lampID, status_property, property, true, &status_field, 1)){
+            muzzley_publish_lampState(lampID, onoff_state, _muzzley_lighting_client);
+        }
        
-        double value_double = color_remap_double(brightness_int, COLOR_MIN, COLOR_MAX_PERCENT, COLOR_MIN, 1);
-        muzzley_publish_brightness(lampID, value_double, _muzzley_lighting_client);
-        
-
-        double        hue_double = hue_int;
-        double saturation_double = color_remap_double(saturation_int, COLOR_MIN, COLOR_MAX_PERCENT, COLOR_MIN, COLOR_DOUBLE_MAX);
-                    value_double = color_remap_double(brightness_int, COLOR_MIN, COLOR_MAX_PERCENT, COLOR_MIN, COLOR_DOUBLE_MAX);
-
-
-        double red_double, green_double, blue_double;
-        HSVtoRGB(&red_double, &green_double, &blue_double, hue_double, saturation_double, value_double);
-
-        int red   = (int)color_remap_double(red_double,   COLOR_MIN, COLOR_DOUBLE_MAX, COLOR_MIN, COLOR_RGB_MAX);
-        int green = (int)color_remap_double(green_double, COLOR_MIN, COLOR_DOUBLE_MAX, COLOR_MIN, COLOR_RGB_MAX);
-        int blue  = (int)color_remap_double(blue_double,  COLOR_MIN, COLOR_DOUBLE_MAX, COLOR_MIN, COLOR_RGB_MAX);
-
-        printf("\nHue: %f\n", hue_double);
-        printf("Saturation: %f\n", saturation_double);
-        printf("Brightness: %f\n", value_double);
-        printf("Red: %f\n", red_double);
-        printf("Green: %f\n", green_double);
-        printf("Blue: %f\n", blue_double);  
-        printf("Red: %d\n", red);
-        printf("Green: %d\n", green);
-        printf("Blue: %d\n\n", blue);
-        
-        if(strcmp(muzzley_color_mode.c_str(), PROPERTY_COLOR_RGB)==0){
-        	muzzley_publish_lampColor_rgb(lampID, red, green, blue, _muzzley_lighting_client);
+        double value_double = (double)brightness_int / COLOR_MAX_PERCENT;
+        if(muzzley_lamp_property_due(lampID, brightness_property, property, true, &value_double, 1)){
+            muzzley_publish_brightness(lampID, value_double, _muzzley_lighting_client);
+        }
+
+        //RGB is converted only when it is published as an event, read or pending a read
+        if(rgb_mode || property == rgb_property || muzzley_requests.Has(lampID, rgb_property)){
+            double saturation_double = (double)saturation_int / COLOR_MAX_PERCENT;
+            double red_double, green_double, blue_double;
+            HSVtoRGB(&red_double, &green_double, &blue_double, hue_int, saturation_double, value_double);
+
+            int red   = (int)(red_double   * COLOR_RGB_MAX);
+            int green = (int)(green_double * COLOR_RGB_MAX);
+            int blue  = (int)(blue_double  * COLOR_RGB_MAX);
+            double rgb_fields[] = {(double)red, (double)green, (double)blue};
+            if(muzzley_lamp_property_due(lampID, rgb_property, property, rgb_mode, rgb_fields, 3)){
+                muzzley_publish_lampColor_rgb(lampID, red, green, blue, _muzzley_lighting_client);
+            }
         }
  
         return true;
@@ -2108,14 +1870,20 @@ bool muzzley_parseLampState(LSFString lampID, LampState lampState, muzzley::Clie
     }
 }
 
+bool muzzley_check_lamp_write(int status){
+    if(status != LSF_OK)
+        cout << "LampManager Error!" << endl << flush;
+    if(status == 1)
+        cout << "No lighting controller service running!" << endl << flush;
+    return status == LSF_OK;
+}
+
 bool muzzley_handle_lighting_write_status_request(LampManager* lampManager, string component, bool bool_status){
-    int status;
     try{
-        status = lampManager->TransitionLampStateOnOffField(component, bool_status);
-        if(status != LSF_OK)
-            cout << "LampManager Error!" << endl << flush;
-        if(status == 1)
-            cout << "No lighting controller service running!" << endl << flush;
+        muzzley_lamp_writes.Submit(component, MUZZLEY_WRITE_STATUS, [lampManager, component, bool_status] () -> bool {
+            int status = lampManager->TransitionLampStateOnOffField(component, bool_status);
+            return muzzley_check_lamp_write(status);
+        });
         return true;
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
@@ -2124,7 +1892,6 @@ bool muzzley_handle_lighting_write_status_request(LampManager* lampManager, stri
 }
 
 bool muzzley_handle_lighting_write_brightness_request(LampManager* lampManager, string component, double brightness){
-    int status;
     try{
         brightness = color_remap_double(brightness, COLOR_MIN, COLOR_DOUBLE_MAX, COLOR_MIN, (COLOR_MAX_UINT32-1));
         long long long_brightness = (long long) brightness;
@@ -2132,11 +1899,10 @@ bool muzzley_handle_lighting_write_brightness_request(LampManager* lampManager,
         printf("Received brightness double: %f\n", brightness);
         printf("Received brightness long: %lld\n", long_brightness);
 
-        status = lampManager->TransitionLampStateBrightnessField(component, long_brightness);
-        if(status != LSF_OK)
-            cout << "LampManager Error!" << endl << flush;
-        if(status == 1)
-            cout << "No lighting controller service running!" << endl << flush;
+        muzzley_lamp_writes.Submit(component, MUZZLEY_WRITE_BRIGHTNESS, [lampManager, component, long_brightness] () -> bool {
+            int status = lampManager->TransitionLampStateBrightnessField(component, long_brightness);
+            return muzzley_check_lamp_write(status);
+        });
         return true;
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
@@ -2145,7 +1911,6 @@ bool muzzley_handle_lighting_write_brightness_request(LampManager* lampManager,
 }
 
 bool muzzley_handle_lighting_write_HSVT_request(LampManager* lampManager, string component, int hue, int saturation, int value, int colortemp){
-    int status;
     try{
         
         double hue_double        = color_remap_double(hue,        COLOR_MIN,                  COLOR_MAX_360DEG,          COLOR_MIN,                 COLOR_DOUBLE_MAX);
@@ -2170,12 +1935,11 @@ bool muzzley_handle_lighting_write_HSVT_request(LampManager* lampManager, string
    
         //onoff/Hue/Saturation/Colortemp/Brightness
         LampState state(true, long_hue, long_saturation, long_colortemp, long_brightness);
-        status = lampManager->TransitionLampState(component, state);
-
-        if(status != LSF_OK)
-            cout << "LampManager Error!" << endl << flush;
-        if(status == 1)
-            cout << "No lighting controller service running!" << endl << flush;
+        muzzley_lamp_writes.Submit(component, MUZZLEY_WRITE_COLOR, [lampManager, component, state] () -> bool {
+            int status = lampManager->TransitionLampState(component, state);
+            return muzzley_check_lamp_write(status);
+        });
+        return true;
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
         return false;
@@ -2266,6 +2030,8 @@ bool muzzley_handle_lighting_write_colorname_request(LampManager* lampManager, s
 
 bool muzzley_handle_lighting_request_unreachable(string lampID, muzzley::Client* _client){
     try{
+        //Everything is published again once the lamp is back
+        muzzley_lamp_deltas.Forget(lampID);
         muzzley_publish_lampReachable(lampID, false, _client);
         muzzley_publish_lampState(lampID, false, _client);
         muzzley_publish_brightness(lampID, 0, _client);
@@ -2290,23 +2056,35 @@ bool muzzley_handle_lighting_request_unreachable(string lampID, muzzley::Client*
 }
 
 
-bool muzzley_handle_lighting_read_request(LampManager* lampManager, string component, string property, string cid, int t){
+bool muzzley_request_lamp_state(LampManager* lampManager, string component){
+    //Reads for a lamp with a GetLampState in flight wait for its reply
+    if(!muzzley_pending_calls.Join(LSF_METHOD_GETLAMPSTATE, component)){
+        cout << "Joined in flight GetLampState for lamp id: " << component << endl << flush;
+        return true;
+    }
+
+    int status = lampManager->GetLampState(component);
+    if(status != LSF_OK){
+        muzzley_pending_calls.Complete(LSF_METHOD_GETLAMPSTATE, component);
+        cout << "LampManager Error!" << endl << flush;
+        if(status == 1){
+            cout << "No lighting controller service running!" << endl << flush;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool muzzley_handle_lighting_read_request(LampManager* lampManager, string component, string property, string cid, int t, muzzley::Client* _client){
     try{
-        add_request_vector_pos(component, property, cid, t, DEVICE_BULB);
-        if(!strcmp(property.c_str(), PROPERTY_REACHABLE)){
-            int status = lampManager->GetLampState(component);
+        muzzley_add_read_request(component, property, cid, t, DEVICE_BULB);
 
-            usleep(LSF_LAMPMANAGER_SLEEP);
-            if(status != LSF_OK){
-                cout << "LampManager Error!" << endl << flush;
-                return true;
-            }
-            if(status == 1){
-                cout << "No lighting controller service running!" << endl << flush;
-                return false;
-            }
+        MuzzleyLampShadow shadow;
+        if(muzzley_lamp_cache.GetFresh(component, shadow)){
+            cout << "Answering " << property << " for lamp id: " << component << " from the state cache" << endl << flush;
+            return muzzley_parseLampState(component, shadow.state, _client, property);
         }
-        return true;
+        return muzzley_request_lamp_state(lampManager, component);
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
         return false;
@@ -2335,44 +2113,40 @@ bool muzzley_handle_lighting_request(LampManager* lampManager, muzzley::JSONObjT
         if(!muzzley_lamplist_check_lamp(component)){
             cout << "Received request for: " << property << " Lamp id: " << component << " from user id: " << user_id << " Name: " << user_name << endl << endl << flush;
             if(io=="r"){
-                if(add_request_vector_pos(component, property, cid, t, DEVICE_BULB))
+                if(muzzley_add_read_request(component, property, cid, t, DEVICE_BULB))
                     cout << "Added request sucessfully!!" << endl << flush;
                 else
                     cout << "Failed to add request " << endl << flush;
             }
             
             muzzley_handle_lighting_request_unreachable(component, _client);
-            
-           
-            int status = lampManager->GetAllLampIDs();
-            muzzley_query_unknown_lampnames(lampManager);
-            usleep(LSF_LAMPMANAGER_SLEEP);
+            muzzley_update_lamplist(lampManager);
             return false;
         }
 
-        print_request_vector();
+        print_request_table();
 
         if (io=="r"){
             if(!strcmp(property.c_str(), PROPERTY_REACHABLE)){
-                muzzley_handle_lighting_read_request(lampManager, component, property, cid, t);
+                muzzley_handle_lighting_read_request(lampManager, component, property, cid, t, _client);
                 return true;
             } else if(!strcmp(property.c_str(), PROPERTY_STATUS)){
-                muzzley_handle_lighting_read_request(lampManager, component, property, cid, t);
+                muzzley_handle_lighting_read_request(lampManager, component, property, cid, t, _client);
                 return true;
             } else if(!strcmp(property.c_str(), PROPERTY_BRIGHTNESS)){
-                muzzley_handle_lighting_read_request(lampManager, component, property, cid, t);
+                muzzley_handle_lighting_read_request(lampManager, component, property, cid, t, _client);
                 return true;
             } else if(!strcmp(property.c_str(), PROPERTY_COLOR_RGB)){
-                muzzley_handle_lighting_read_request(lampManager, component, property, cid, t);
+                muzzley_handle_lighting_read_request(lampManager, component, property, cid, t, _client);
                 return true;
             } else if(!strcmp(property.c_str(), PROPERTY_COLOR_HSV)){
-                muzzley_handle_lighting_read_request(lampManager, component, property, cid, t);
+                muzzley_handle_lighting_read_request(lampManager, component, property, cid, t, _client);
                 return true;
             } else if(!strcmp(property.c_str(), PROPERTY_COLOR_HSVT)){
-                muzzley_handle_lighting_read_request(lampManager, component, property, cid, t);
+                muzzley_handle_lighting_read_request(lampManager, component, property, cid, t, _client);
                 return true;
             } else if(!strcmp(property.c_str(), PROPERTY_COLOR_NAME)){
-                muzzley_handle_lighting_read_request(lampManager, component, property, cid, t);
+                muzzley_handle_lighting_read_request(lampManager, component, property, cid, t, _client);
                 return true;
             } else {
                 cout << "Received a request with a unknown property type" << endl << flush;
@@ -2437,7 +2211,7 @@ bool muzzley_handle_lighting_request(LampManager* lampManager, muzzley::JSONObjT
 
 bool muzzley_publish_plug_state(string plugID, bool onoff){
     try{
-        return muzzley_publish(MUZZLEY_WORKSPACE, muzzley_plugs_profileid, muzzley_plugs_deviceKey, plugID, PROPERTY_STATUS, onoff, &_muzzley_plugs_client);
+        return muzzley_publish(MUZZLEY_WORKSPACE, muzzley_plugs_profileid, muzzley_get_deviceKey(muzzley_plugs_deviceKey), plugID, PROPERTY_STATUS, onoff, &_muzzley_plugs_client);
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
         return false;
@@ -2446,232 +2220,184 @@ bool muzzley_publish_plug_state(string plugID, bool onoff){
 
 bool muzzley_publish_plug_string(string plugID, string property, string value){
     try{
-        return muzzley_publish(MUZZLEY_WORKSPACE, muzzley_plugs_profileid, muzzley_plugs_deviceKey, plugID, property, value, &_muzzley_plugs_client);
+        return muzzley_publish(MUZZLEY_WORKSPACE, muzzley_plugs_profileid, muzzley_get_deviceKey(muzzley_plugs_deviceKey), plugID, property, value, &_muzzley_plugs_client);
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
         return false;
     }    
 }
 
-void muzzley_handle_plug_read_status_request(string component, string cid, int t){
-    time_t tm = std::time(0);
-    req_vec.push_back(make_tuple(component, PROPERTY_STATUS, cid, t, tm, DEVICE_PLUG));
-
-    int pos = get_plug_vector_pos(component);
-    Property* status_property = get_plug_vector_property_status(pos);
+string muzzley_plug_property_value(Property* property){
+    const char* chars = property->getPropertyValue().charValue;
+    return chars==NULL ? "" : chars;
+}
 
-    if(status_property==NULL){
-        return;
-    }else{
-        const char* status = status_property->getPropertyValue().charValue;
-        cout << "Plug Status: " << status << endl << flush;
-        bool onoff;
-        
-        if(strcmp(status, "Switch On")==0)
-            onoff=true;
-        else
-            onoff=false;
-        
-        muzzley_publish_plug_state(component, onoff);
+//Reads a plug property widget and keeps the value in the plug list
+bool muzzley_read_plug_value(const MuzzleyPlug& plug, MuzzleyPlugValue value, string& data){
+    Property* property = plug.properties[value];
+    if(property==NULL){
+        cout << "Plug " << muzzley_plug_value_property[value] << " not found" << endl << flush;
+        return false;
     }
-
+    data = muzzley_plug_property_value(property);
+    muzzley_pluglist.SetValue(plug.id, value, data);
+    return true;
 }
 
-void muzzley_handle_plug_read_voltage_request(string component, string cid, int t){
-    time_t tm = std::time(0);
-    req_vec.push_back(make_tuple(component, PROPERTY_VOLTAGE, cid, t, tm, DEVICE_PLUG));
-    
-    int pos = get_plug_vector_pos(component);
-    if(pos==-1)
-        return;
-
-    Property* voltage_property = get_plug_vector_property_voltage(pos);
-
-    if(voltage_property==NULL){
-        cout << "Voltage not found" << endl << flush; 
+//Publishes a plug value, the status is published as a boolean
+void muzzley_publish_plug_value(string component, MuzzleyPlugValue value, string data){
+    if(value==PLUG_STATUS){
+        muzzley_publish_plug_state(component, data=="Switch On");
     }else{
-        const char* voltage = voltage_property->getPropertyValue().charValue;
-        muzzley_publish_plug_string(component, PROPERTY_VOLTAGE, voltage);
+        muzzley_publish_plug_string(component, muzzley_plug_value_property[value], data);
     }
 }
 
-void muzzley_handle_plug_read_current_request(string component, string cid, int t){
-    time_t tm = std::time(0);
-    req_vec.push_back(make_tuple(component, PROPERTY_CURRENT, cid, t, tm, DEVICE_PLUG));
+void muzzley_handle_plug_read_request(string component, MuzzleyPlugValue value, string cid, int t){
+    muzzley_add_read_request(component, muzzley_plug_value_property[value], cid, t, DEVICE_PLUG);
 
-    int pos = get_plug_vector_pos(component);
-    if(pos==-1)
+    MuzzleyPlug plug;
+    if(!muzzley_pluglist.Get(component, plug))
         return;
 
-    Property* current_property = get_plug_vector_property_current(pos);
-
-    if(current_property==NULL){
-        cout << "Current not found" << endl << flush; 
-    }else{
-        const char* current = current_property->getPropertyValue().charValue;
-        muzzley_publish_plug_string(component, PROPERTY_CURRENT, current);
+    string data;
+    if(muzzley_read_plug_value(plug, value, data)){
+        cout << "Plug " << muzzley_plug_value_property[value] << ": " << data << endl << flush;
+        muzzley_publish_plug_value(component, value, data);
     }
 }
 
-void muzzley_handle_plug_read_frequency_request(string component, string cid, int t){
-    string property = PROPERTY_FREQUENCY;
-    time_t tm = std::time(0);
-    req_vec.push_back(make_tuple(component, property, cid, t, tm, DEVICE_PLUG));
+void muzzley_handle_plug_write_status_request(string component, bool bool_status){
 
-    int pos = get_plug_vector_pos(component);
-    if(pos==-1)
+    MuzzleyPlug plug;
+    if(!muzzley_pluglist.Get(component, plug))
         return;
 
-    Property* frequency_property = get_plug_vector_property_frequency(pos);
-
-    if(frequency_property==NULL){
-        cout << "Frequency not found" << endl << flush; 
+    if(plug.properties[PLUG_STATUS]==NULL){
+        cout << "Status not found" << endl << flush; 
     }else{
-        const char* frequency = frequency_property->getPropertyValue().charValue;
-        muzzley_publish_plug_string(component, property, frequency);
+        if(bool_status){
+            alljoyn_execute_action(plug.actions[PLUG_ON]);
+        }
+        else{  
+            alljoyn_execute_action(plug.actions[PLUG_OFF]);
+        }
     }
 }
 
-void muzzley_handle_plug_read_power_request(string component, string cid, int t){
-    time_t tm = std::time(0);
-    req_vec.push_back(make_tuple(component, PROPERTY_POWER, cid, t, tm, DEVICE_PLUG));
-
-    int pos = get_plug_vector_pos(component);
-    if(pos==-1)
-        return;
-
-    Property* power_property = get_plug_vector_property_power(pos);
+//Parses a plug meter reading, false if the widget holds no number
+bool muzzley_plug_reading(const string& data, double& sample){
+    char* end;
+    double reading = strtod(data.c_str(), &end);
+    if(end==data.c_str())
+        return false;
+    sample = reading;
+    return true;
+}
 
-    if(power_property==NULL){
-        cout << "Power not found" << endl << flush; 
-    }else{
-        const char* energy = power_property->getPropertyValue().charValue;
-        muzzley_publish_plug_string(component, PROPERTY_POWER, energy);
+//Records the last reading of every plug value in the history, a value the plug did not
+//signal again is carried forward so the buckets cover time and not only the changes
+bool muzzley_record_plug_readings(){
+    try{
+        time_t now = time(0);
+        vector<MuzzleyPlug> plugs = muzzley_pluglist.List();
+        for (unsigned int i = 0; i < plugs.size(); i++){
+            //The status is not metered
+            for (int value = PLUG_STATUS + 1; value < PLUG_VALUE_COUNT; value++){
+                double sample;
+                if(muzzley_plug_reading(plugs[i].values[value], sample))
+                    muzzley_plug_meter.Add(plugs[i].id, (MuzzleyPlugValue)value, sample, now);
+            }
+        }
+    }catch(exception& e){
+        cout << "Exception: " << e.what() << endl << flush;
     }
+    return true;
 }
 
-void muzzley_handle_plug_read_energy_request(string component, string cid, int t){
-    time_t tm = std::time(0);
-    req_vec.push_back(make_tuple(component, PROPERTY_ENERGY, cid, t, tm, DEVICE_PLUG));
+//A plug widget changed on the device, only a value different from the last one is published
+void muzzley_handle_plug_property_changed(Property* property){
+    try{
+        string component;
+        MuzzleyPlugValue value;
+        if(!muzzley_pluglist.FindProperty(property, component, value))
+            return;
 
-    int pos = get_plug_vector_pos(component);
-    if(pos==-1)
-        return;
+        string data = muzzley_plug_property_value(property);
 
-    Property* energy_property = get_plug_vector_property_energy(pos);
+        //A power change may bring the plug back to the shortest sampling interval
+        double sample;
+        if(value==PLUG_POWER && muzzley_plug_reading(data, sample))
+            muzzley_plug_sampler.Observe(component, sample);
 
-    if(energy_property==NULL){
-        cout << "Energy not found" << endl << flush; 
-    }else{
-        const char* energy = energy_property->getPropertyValue().charValue;
-        muzzley_publish_plug_string(component, PROPERTY_ENERGY, energy);
+        if(muzzley_pluglist.SetValue(component, value, data)){
+            cout << "Plug " << component << " " << muzzley_plug_value_property[value] << ": " << data << endl << flush;
+            muzzley_publish_plug_value(component, value, data);
+        }
+    }catch(exception& e){
+        cout << "Exception: " << e.what() << endl << flush;
     }
 }
 
-
-void muzzley_handle_plug_write_status_request(string component, bool bool_status){
-
-    int pos = get_plug_vector_pos(component);
-    if(pos==-1)
-        return;
-
-    Property* status_property = get_plug_vector_property_status(pos);
-    Action* seton_action = get_plug_vector_action_set_on(pos);
-    Action* setoff_action = get_plug_vector_action_set_off(pos);
-
-    if(status_property==NULL){
-        cout << "Status not found" << endl << flush; 
-    }else{
-        if(bool_status){
-            alljoyn_execute_action(seton_action);
-            //muzzley_publish_plug_state(component, true);                        
+//Stores the last complete minute of every plug, a minute without history holds the last readings known
+bool muzzley_store_plug_energy(){
+    try{
+        time_t minute = time(0) / 60 * 60 - 60;
+        vector<MuzzleyPlug> plugs = muzzley_pluglist.List();
+        for (unsigned int i = 0; i < plugs.size(); i++){
+            vector<MuzzleyMeterBucket> power = muzzley_plug_meter.Query(plugs[i].id, PLUG_POWER, MuzzleyMeterHistory::TIER_MINUTE, minute, minute);
+            vector<MuzzleyMeterBucket> energy = muzzley_plug_meter.Query(plugs[i].id, PLUG_ENERGY, MuzzleyMeterHistory::TIER_MINUTE, minute, minute);
+            double power_value = NAN;
+            double energy_value = NAN;
+            if(!power.empty())
+                power_value = power[0].Avg();
+            else
+                muzzley_plug_reading(plugs[i].values[PLUG_POWER], power_value);
+            if(!energy.empty())
+                energy_value = energy[0].max;
+            else
+                muzzley_plug_reading(plugs[i].values[PLUG_ENERGY], energy_value);
+            //A plug that never reported a reading has nothing to store yet
+            if(std::isnan(power_value) && std::isnan(energy_value))
+                continue;
+            muzzley_plug_energy.Append(plugs[i].id, minute, power_value, energy_value);
         }
-        else{  
-            alljoyn_execute_action(setoff_action);
-            //muzzley_publish_plug_state(component, false);
-          }
+    }catch(exception& e){
+        cout << "Exception: " << e.what() << endl << flush;
     }
+    return true;
 }
 
-void muzzley_update_plug_properties(string component){
-
-    int pos = get_plug_vector_pos(component);
-    if(pos==-1)
+//Fills the history of a plug seen for the first time with what was stored by previous runs
+void muzzley_load_plug_energy(string component){
+    MuzzleyMeterBucket bucket;
+    if(muzzley_plug_meter.Last(component, PLUG_POWER, MuzzleyMeterHistory::TIER_HOUR, bucket) ||
+       muzzley_plug_meter.Last(component, PLUG_ENERGY, MuzzleyMeterHistory::TIER_HOUR, bucket))
         return;
 
-    /*
-    Action* getp_action = get_plug_vector_action_getproperties(pos);
-    if(getp_action==NULL)
-        cout << "Get Properties action not found" << endl << flush; 
-    else{
-        sleep(2);
-        alljoyn_execute_action(getp_action);
+    time_t now = time(0);
+    vector<MuzzleyEnergySample> samples = muzzley_plug_energy.Query(component, now - MUZZLEY_METER_HOURS * 3600, now);
+    for (unsigned int i = 0; i < samples.size(); i++){
+        if(!std::isnan(samples[i].power))
+            muzzley_plug_meter.Add(component, PLUG_POWER, samples[i].power, samples[i].time);
+        if(!std::isnan(samples[i].energy))
+            muzzley_plug_meter.Add(component, PLUG_ENERGY, samples[i].energy, samples[i].time);
     }
-    */
+    if(!samples.empty())
+        cout << "Loaded " << samples.size() << " stored readings of plug " << component << endl << flush;
+}
 
-    /*
-    double property_duration = difftime(time(0), get_plug_vector_time(pos));
-    if(property_duration>2){
-        Action* getp_action = get_plug_vector_action_getproperties(pos);
-        if(getp_action==NULL)
-            cout << "Get Properties action not found" << endl << flush; 
-        else
-            alljoyn_execute_action(getp_action);
-    }
-    */
+//Asks a plug for new readings, they arrive as widget signals
+void muzzley_sample_plug(const string& component){
+    //A plug that kept its power sends no signal, the sampler sees the value it holds
+    string data;
+    double sample;
+    if(muzzley_pluglist.GetValue(component, PLUG_POWER, data) && muzzley_plug_reading(data, sample))
+        muzzley_plug_sampler.Observe(component, sample);
 
-    Action* getp_action = get_plug_vector_action_getproperties(pos);
-    if(getp_action==NULL)
-        cout << "Get Properties action not found" << endl << flush; 
-    else
+    Action* getp_action = muzzley_pluglist.GetAction(component, PLUG_GET_PROPERTIES);
+    if(getp_action!=NULL)
         alljoyn_execute_action(getp_action);
-
-    Property* status_property = get_plug_vector_property_status(pos);
-    Property* voltage_property = get_plug_vector_property_voltage(pos);
-    Property* current_property = get_plug_vector_property_current(pos);
-    Property* frequency_property = get_plug_vector_property_frequency(pos);
-    Property* power_property = get_plug_vector_property_power(pos);
-    Property* energy_property = get_plug_vector_property_energy(pos);
-
-    if(status_property==NULL){
-        cout << "Status not found" << endl << flush; 
-    }else{
-        const char* status = status_property->getPropertyValue().charValue;\
-        if(strcmp(status, "Switch On")==0){
-            muzzley_publish_plug_state(component, true);
-        }else
-            muzzley_publish_plug_state(component, false);
-    }
-    if(voltage_property==NULL){
-        cout << "Voltage not found" << endl << flush; 
-    }else{
-        const char* voltage = voltage_property->getPropertyValue().charValue;
-        muzzley_publish_plug_string(component, PROPERTY_VOLTAGE, voltage);
-    }
-    if(current_property==NULL){
-        cout << "Current not found" << endl << flush; 
-    }else{
-        const char* current = current_property->getPropertyValue().charValue;
-        muzzley_publish_plug_string(component, PROPERTY_CURRENT, current);
-    }
-    if(frequency_property==NULL){
-        cout << "Frequency not found" << endl << flush; 
-    }else{
-        const char* freq = frequency_property->getPropertyValue().charValue;
-        muzzley_publish_plug_string(component, PROPERTY_FREQUENCY, freq);
-    }
-    if(power_property==NULL){
-        cout << "Power not found" << endl << flush; 
-    }else{
-        const char* power = power_property->getPropertyValue().charValue;
-        muzzley_publish_plug_string(component, PROPERTY_POWER, power);
-    }
-    if(energy_property==NULL){
-        cout << "Energy not found" << endl << flush; 
-    }else{
-        const char* energy = energy_property->getPropertyValue().charValue;
-        muzzley_publish_plug_string(component, PROPERTY_ENERGY, energy);
-    }
 }
 
 bool muzzley_handle_plug_request(muzzley::JSONObjT _data){
@@ -2691,45 +2417,28 @@ bool muzzley_handle_plug_request(muzzley::JSONObjT _data){
         }
     }
 
-    if(!muzzley_plug_vector_check(component)){
+    if(!muzzley_pluglist.Has(component)){
         cout << "Received request for unknown plug id: " << component << " from iser id: " << user_id << " Name: " << user_name << endl << flush;
         return false;
     }
 
-    print_request_vector();
-    muzzley_plug_vector_print();
-    
-    int pos = get_plug_vector_pos(component);
-    if (pos==-1)
-        return false;
+    print_request_table();
 
     if (io=="r"){
         cout << "Receiving read request for plug" << endl << flush;
         
-        if(property==PROPERTY_STATUS){
-            muzzley_handle_plug_read_status_request(component, cid, t);
-        }
-        if(property==PROPERTY_VOLTAGE){
-            muzzley_handle_plug_read_voltage_request(component, cid, t);
-        }
-        if(property==PROPERTY_CURRENT){
-            muzzley_handle_plug_read_current_request(component, cid, t);
-        }
-        if(property==PROPERTY_FREQUENCY){
-            muzzley_handle_plug_read_frequency_request(component, cid, t);
-        }
-        if(property==PROPERTY_POWER){
-            muzzley_handle_plug_read_power_request(component, cid, t);
-        }
-        if(property==PROPERTY_ENERGY){
-            muzzley_handle_plug_read_energy_request(component, cid, t);
+        for (int value = 0; value < PLUG_VALUE_COUNT; value++){
+            if(property==muzzley_plug_value_property[value]){
+                muzzley_handle_plug_read_request(component, (MuzzleyPlugValue)value, cid, t);
+                break;
+            }
         }
     }
     if (io=="w"){
         if(property==PROPERTY_STATUS){
             bool bool_status = (bool)_data["d"]["p"]["data"]["value"];
+            //The new status is published when the device signals it
             muzzley_handle_plug_write_status_request(component, bool_status);
-            muzzley_update_plug_properties(component);
         }
     }
     
@@ -2833,21 +2542,19 @@ public:
             lampList = lampIDs;
 
 
-            int size=0;
-            string component;
             if(lampIDs.size()==0){
-                size = get_request_vector_size();
-                if(size>0){
-                   for(int i=0; i<size; i++){
-                        component = get_request_vector_component(i);
-                        muzzley_handle_lighting_request_unreachable(component, this->_client);
-                    } 
+                vector <string> components;
+                muzzley_requests.GetComponents(components);
+                for(unsigned int i=0; i<components.size(); i++){
+                    muzzley_handle_lighting_request_unreachable(components[i], this->_client);
                 }
             }
 
-            if(!muzzley_lamplist_replace_lamplist(lampIDs))
-                muzzley_replace_lighting_components();
+            MuzzleyLampDelta delta;
+            if(!muzzley_lamplist_replace_lamplist(lampIDs, delta))
+                muzzley_apply_lighting_delta(delta);
         }
+        muzzley_pending_calls.Complete(LSF_METHOD_GETALLLAMPIDS, "", responseCode == LSF_OK);
     }
 
     void GetLampNameReplyCB(const LSFResponseCode& responseCode, const LSFString& lampID, const LSFString& language, const LSFString& lampName) {
@@ -2855,38 +2562,47 @@ public:
         printf("\n%s:\nresponseCode; %s\nlampID: %s\nlanguage: %s\n", __func__, LSFResponseCodeText(responseCode), uniqueId.data(), language.data());
         if (responseCode == LSF_OK) {
             printf("lampName = %s\n\n", lampName.data());
-            for ( unsigned i = 0; i < muzzley_lamplist.bucket_count(); ++i) {
-                for ( auto local_it = muzzley_lamplist.begin(i); local_it!= muzzley_lamplist.end(i); ++local_it ){
-                    if(local_it->first == lampID.data() ){
-                        local_it->second = lampName.data();
-                        cout << endl << "Lamp ID: " << lampID << endl << "Name: " << lampName << " was updated in lamplist" << endl << endl << flush; 
-                    }
-                }
-            }
-            muzzley_add_lighting_component(lampID, lampName);
         }
+        muzzley_name_resolver.Reply(lampID.c_str(), responseCode == LSF_OK, lampName.c_str());
     }
 
     void LampNameChangedCB(const LSFString& lampID, const LSFString& lampName) {
         printf("\n%s:\nlampID = %s\nlampName = %s", __func__, lampID.data(), lampName.data());
-        muzzley_lamplist[lampID.data()]=lampName;
-        muzzley_add_lighting_component(lampID, lampName);
+        muzzley_lamplist.SetName(lampID, lampName);
+        muzzley_lighting_sync.Add(lampID, lampName);
     }
     
     void GetLampStateReplyCB(const LSFResponseCode& responseCode, const LSFString& lampID, const LampState& lampState) {
         LSFString uniqueId = lampID;
         printf("\n%s:\nresponseCode: %s\nlampID: %s", __func__, LSFResponseCodeText(responseCode), uniqueId.data());
+        unsigned int waiters = muzzley_pending_calls.Complete(LSF_METHOD_GETLAMPSTATE, lampID.c_str(), responseCode == LSF_OK);
+        printf("\nwaiting reads: %u", waiters);
         if (responseCode == LSF_OK) {
-            printf("\nstate: %s\n", lampState.c_str());
+            printf("\n");
+            muzzley_lamp_cache.Update(lampID.c_str(), lampState);
             muzzley_parseLampState(lampID, lampState, this->_client);
         } else {
             cout << endl << "LSF Timeout!" << endl << flush;
+            muzzley_lamp_cache.SetUnreachable(lampID.c_str());
             muzzley_handle_lighting_request_unreachable(lampID, this->_client);
         }
     }
 
+    void TransitionLampStateReplyCB(const LSFResponseCode& responseCode, const LSFString& lampID) {
+        muzzley_lamp_writes.Completed(lampID);
+    }
+
+    void TransitionLampStateOnOffFieldReplyCB(const LSFResponseCode& responseCode, const LSFString& lampID) {
+        muzzley_lamp_writes.Completed(lampID);
+    }
+
+    void TransitionLampStateBrightnessFieldReplyCB(const LSFResponseCode& responseCode, const LSFString& lampID) {
+        muzzley_lamp_writes.Completed(lampID);
+    }
+
     void LampStateChangedCB(const LSFString& lampID, const LampState& lampState) {
-        printf("\n%s:\nlampID: %s\nlampState: \n\n%s\n\n", __func__, lampID.data(), lampState.c_str());
+        printf("\n%s:\nlampID: %s\n", __func__, lampID.data());
+        muzzley_lamp_cache.Update(lampID.c_str(), lampState);
         muzzley_parseLampState(lampID, lampState, this->_client);
     }
 
@@ -2897,10 +2613,10 @@ public:
         for (; it != lampIDs.end(); ++it) {
             printf("\n(%d)%s\n", count, (*it).data());
             count++;
-            muzzley_lamplist[(*it).data()]=muzzley_lamplist_get_lampname((*it).data());
+            muzzley_lamplist.Add((*it).data(), MUZZLEY_UNKNOWN_NAME);
+            muzzley_lighting_sync.Add((*it).data(), muzzley_lamplist.GetName((*it).data()));
         }
         printf("\n");
-        muzzley_add_lighting_components(lampIDs);
         lampList.clear();
         lampList = lampIDs;
     }
@@ -2912,10 +2628,14 @@ public:
         for (; it != lampIDs.end(); ++it) {
             printf("\n(%d)%s\n", count, (*it).data());
             muzzley_publish_lampReachable((*it).data(), false, this->_client);
+            muzzley_lamp_cache.Remove((*it).data());
+            muzzley_lamp_deltas.Forget((*it).data());
+            muzzley_lamp_writes.Forget((*it).data());
+            muzzley_name_resolver.Forget((*it).data());
+            muzzley_lighting_sync.Remove((*it).data());
             muzzley_lamplist_del_lamp((*it).data());
             count++;
         }
-        muzzley_remove_lighting_components(lampIDs);
         lampList.clear();
         lampList = lampIDs;
     }
@@ -2960,181 +2680,149 @@ class MyReceiver : public NotificationReceiver {
     }
 };
 
-void muzzley_parse_plugs_controlpanelunit(string device_id_str, string device_name_str, ControlPanelControllerUnit* cp_unit){
+//Walks the panel of a plug model seen for the first time and matches its widgets by label
+MuzzleyWidgetLayouts::Layout muzzley_learn_plug_layout(Container* rootContainer){
+    MuzzleyWidgetLayouts::Layout layout(PLUG_SLOT_COUNT);
+    cout << "AnnounceHandler learning plug panel layout" << endl << flush;
+
+    std::vector<Widget*> childWidgets = rootContainer->getChildWidgets();
+    for (unsigned int i = 0; i < childWidgets.size(); i++) {
+        WidgetType widgetType = childWidgets[i]->getWidgetType();
+        cout << "Widget " << i << " Type: " << widgetType << " Label: " << childWidgets[i]->getLabel() << endl << flush;
+
+        //The status is the property of the root container
+        if(widgetType==WIDGET_TYPE_PROPERTY){
+            layout[PLUG_STATUS].path = MuzzleyWidgetLayouts::Path(1, i);
+            layout[PLUG_STATUS].type = widgetType;
+            layout[PLUG_STATUS].label = childWidgets[i]->getLabel().c_str();
+        }
+        if(widgetType!=WIDGET_TYPE_CONTAINER)
+            continue;
+
+        std::vector<Widget*> childchildWidgets = ((Container*)childWidgets[i])->getChildWidgets();
+        for (unsigned int j = 0; j < childchildWidgets.size(); j++) {
+            widgetType = childchildWidgets[j]->getWidgetType();
+            const qcc::String label = childchildWidgets[j]->getLabel();
+            cout << "    Widget " << i << "." << j << " Type: " << widgetType << " Label: " << label << endl << flush;
+
+            MuzzleyWidgetLayouts::Path path;
+            path.push_back(i);
+            path.push_back(j);
+            if(widgetType==WIDGET_TYPE_ACTION){
+                for (int action = 0; action < PLUG_ACTION_COUNT; action++){
+                    if(label==muzzley_plug_action_label[action]){
+                        layout[PLUG_VALUE_COUNT + action].path = path;
+                        layout[PLUG_VALUE_COUNT + action].type = widgetType;
+                        layout[PLUG_VALUE_COUNT + action].label = label.c_str();
+                    }
+                }
+            }
+            if(widgetType==WIDGET_TYPE_PROPERTY){
+                for (int value = PLUG_STATUS + 1; value < PLUG_VALUE_COUNT; value++){
+                    if(label==muzzley_plug_property_label[value]){
+                        layout[value].path = path;
+                        layout[value].type = widgetType;
+                        layout[value].label = label.c_str();
+                    }
+                }
+            }
+        }
+    }
+    return layout;
+}
+
+//Check that every plug value and action was found in a learned layout
+bool muzzley_plug_layout_complete(const MuzzleyWidgetLayouts::Layout& layout){
+    for (unsigned int i = 0; i < layout.size(); i++){
+        if(layout[i].path.empty())
+            return false;
+    }
+    return true;
+}
 
-    Property* plug_property_volt=NULL;
-    Property* plug_property_curr=NULL;
-    Property* plug_property_freq=NULL;
-    Property* plug_property_watt=NULL;
-    Property* plug_property_accu=NULL;
-    Property* plug_property_status=NULL;
-    Action* plug_action_on=NULL;
-    Action* plug_action_off=NULL;
-    Action* plug_action_get_properties=NULL;
+//Looks up the SmartPlug unit of a device, NULL if the device or its unit are gone
+ControlPanelControllerUnit* muzzley_get_plug_controlpanelunit(string bus_name){
+    ControlPanelDevice* device = controlPanelController->getControllableDevice(bus_name.c_str());
+    if(device==NULL)
+        return NULL;
+    return device->getControlPanelUnit("ControlPanel/SmartPlug/rootContainer");
+}
+
+void muzzley_parse_plugs_controlpanelunit(string device_id_str, string device_name_str, string manufacturer_str, string model_number_str, string bus_name, ControlPanelControllerUnit* cp_unit, unsigned int attempt=0){
 
     if(cp_unit==NULL)
         return;
     
-    const qcc::String cp_unit_name = cp_unit->getUnitName(); 
-    cout << "AnnounceHandler ControlPanelControllerUnit Name: " << cp_unit_name.c_str() << endl << flush;
-
     ControlPanel* cp_controlpanel = cp_unit->getControlPanel("rootContainer");
     if(cp_controlpanel==NULL){
         cout << "AnnounceHandler RootContainer not found!" << endl << flush;
-    }else{
-            qcc::String cp_panelname = cp_controlpanel->getPanelName();    
-            cout << "AnnounceHandler ControlPanel Name: " << cp_panelname.c_str() << endl << flush;
-
-            const qcc::String cd_path = cp_controlpanel->getObjectPath();
-            cout << "AnnounceHandler ControlPanel Path: " << cd_path.c_str() << endl << flush;
-
-            //Needed by some reason...
-            sleep(1);
-
-            Container* rootContainer = cp_controlpanel->getRootWidget("en");
-            if (rootContainer==NULL) {
-                cout << "AnnounceHandler RootContainer not found!" << endl << flush;
-            }else{
-                cout << "AnnounceHandler RootContainer found!" << endl << flush;
-                if (rootContainer->getWidgetType() == 0) {
-                    std::vector<Widget*> childWidgets = rootContainer->getChildWidgets();
-                    cout << "AnnounceHandler Print ChildWidgets from rootContainer" << endl << endl << flush;
-                    for (size_t i = 0; i < childWidgets.size(); i++) {
-                        WidgetType widgetType = childWidgets[i]->getWidgetType();
-                        qcc::String name = childWidgets[i]->getWidgetName();
-                        bool secured = childWidgets[i]->getIsSecured();
-                        bool enabled = childWidgets[i]->getIsEnabled();
-                        bool writable = childWidgets[i]->getIsWritable();
-
-                        uint32_t states = childWidgets[i]->getStates();
-                        uint32_t bgcolor = childWidgets[i]->getBgColor();
-                        const qcc::String label = childWidgets[i]->getLabel();
-                        cout << "Widget Type: " << widgetType << endl << flush;
-                        std::vector<Widget*> childchildWidgets;
-                            
-                            switch(widgetType){
-                                case WIDGET_TYPE_ACTION:
-                                    cout << "Widget Type: ACTION" << endl << flush;
-                                    break;
-                                case WIDGET_TYPE_ACTION_WITH_DIALOG:
-                                    cout << "Widget Type: ACTION_WITH_DIALOG" << endl << flush;
-                                    break;
-                                case WIDGET_TYPE_LABEL:
-                                    cout << "Widget Type: LABEL" << endl << flush;
-                                    break;
-                                case WIDGET_TYPE_PROPERTY:
-                                    cout << "Widget Type: PROPERTY" << endl << flush;
-                                    plug_property_status=((Property*)childWidgets[i]);
-                                    break;
-                                case WIDGET_TYPE_CONTAINER:
-                                    cout << "Widget Type: CONTAINER" << endl << endl << flush;
-                             
-                                    childchildWidgets = ((Container*)childWidgets[i])->getChildWidgets();
-                                    for (size_t j = 0; j < childchildWidgets.size(); j++) {
-                                        widgetType = childchildWidgets[j]->getWidgetType();
-                                        name = childchildWidgets[j]->getWidgetName();
-                                        secured = childchildWidgets[j]->getIsSecured();
-                                        enabled = childchildWidgets[j]->getIsEnabled();
-                                        writable = childchildWidgets[j]->getIsWritable();
-
-                                        states = childchildWidgets[j]->getStates();
-                                        bgcolor = childchildWidgets[j]->getBgColor();
-                                        const qcc::String label = childchildWidgets[j]->getLabel();
-                                        cout << "    Widget Type: " << widgetType << endl << flush;
-                                            switch(widgetType){
-                                                case WIDGET_TYPE_ACTION:
-                                                    cout << "    Widget Type: ACTION" << endl << flush;
-                                                    if(label=="On")
-                                                        plug_action_on=((Action*)childchildWidgets[j]);
-                                                    else if (label=="Off")
-                                                        plug_action_off=((Action*)childchildWidgets[j]);
-                                                    else if (label=="Get Properties")
-                                                        plug_action_get_properties=((Action*)childchildWidgets[j]);
-                                                    break;
-                                                case WIDGET_TYPE_ACTION_WITH_DIALOG:
-                                                    cout << "    Widget Type: ACTION_WITH_DIALOG" << endl << flush;
-                                                    break;
-                                                case WIDGET_TYPE_LABEL:
-                                                    cout << "    Widget Type: LABEL" << endl << flush;
-                                                    break;
-                                                case WIDGET_TYPE_PROPERTY:
-                                                    cout << "    Widget Type: PROPERTY" << endl << flush;
-                                                    if(label=="Volt(V):"){
-                                                        plug_property_volt=((Property*)childchildWidgets[j]);
-                                                        plug_property_volt->setValue("");
-                                                    }
-                                                    if(label=="Curr(A):"){
-                                                        plug_property_curr=((Property*)childchildWidgets[j]);
-                                                        plug_property_curr->setValue("");
-                                                    }
-                                                    if(label=="Freq(Hz):"){
-                                                        plug_property_freq=((Property*)childchildWidgets[j]);
-                                                        plug_property_freq->setValue("");
-                                                    }
-                                                    if(label=="Watt(W):"){
-                                                        plug_property_watt=((Property*)childchildWidgets[j]);
-                                                        plug_property_watt->setValue("");
-                                                    }
-                                                    if(label=="ACCU(KWH):"){
-                                                        plug_property_accu=((Property*)childchildWidgets[j]);
-                                                        plug_property_accu->setValue("");
-                                                    }
-                                                    break;
-                                                case WIDGET_TYPE_CONTAINER:
-                                                    cout << "    Widget Type: CONTAINER" << endl << flush;
-                                                    break;
-                                                case WIDGET_TYPE_DIALOG:
-                                                    cout << "    Widget Type: DIALOG" << endl << flush;
-                                                    break;
-                                                case WIDGET_TYPE_ERROR:
-                                                    cout << "    Widget Type: ERROR" << endl << flush;
-                                                    break;
-                                                
-                                            }
-                                            cout << "    Label: " << label << endl << flush;
-                                            cout << "    Secured: " << secured << endl << flush;
-                                            cout << "    Enabled: " << enabled << endl << flush;
-                                            cout << "    Writable: " << writable << endl << flush;
-                                            cout << "    States: " << states << endl << flush;
-                                            cout << "    BGcolor: " << bgcolor << endl << endl << flush;
-                                        }
-                                        
-
-                                    break;
-                                case WIDGET_TYPE_DIALOG:
-                                    cout << "Widget Type: DIALOG"<< endl << flush;
-                                    break;
-                                case WIDGET_TYPE_ERROR:
-                                    cout << "Widget Type: ERROR"<< endl << flush;
-                                    break;
-                                
-                            }
-                            cout << "Label: " << label << endl << flush;
-                            cout << "Secured: " << secured << endl << flush;
-                            cout << "Enabled: " << enabled << endl << flush;
-                            cout << "Writable: " << writable << endl << flush;
-                            cout << "States: " << states << endl << flush;
-                            cout << "BGcolor: " << bgcolor << endl << endl << flush;
-                            
-                    }
-                    
-                }
+        return;
+    }
 
-                else if (rootContainer->getWidgetType() == 1) {
-                    cout << "AnnounceHandler Widget type->DIALOG" << endl;
-                } else {
-                    std::cout << "AnnounceHandler RootWidget is of unknown type" << std::endl;
+    //The panel may still be loading, it is looked at again later instead of blocking the announcement
+    Container* rootContainer = cp_controlpanel->getRootWidget("en");
+    bool loaded = rootContainer!=NULL && rootContainer->getWidgetType()==WIDGET_TYPE_CONTAINER && !rootContainer->getChildWidgets().empty();
+
+    //Devices of a known model bind their widgets by position, checked against the labels
+    string layout_key;
+    MuzzleyWidgetLayouts::Layout layout;
+    std::vector<Widget*> widgets;
+    bool learned = false;
+    if(loaded){
+        layout_key = MuzzleyWidgetLayouts::Key(manufacturer_str, model_number_str, rootContainer->getInterfaceVersion());
+        if(!muzzley_plug_layouts.Get(layout_key, layout) || !MuzzleyWidgetLayouts::Bind(rootContainer, layout, widgets)){
+            layout = muzzley_learn_plug_layout(rootContainer);
+            learned = true;
+            //Child containers still loading leave slots empty, only a complete layout is kept for the model
+            loaded = muzzley_plug_layout_complete(layout);
+        }
+    }
+
+    if(!loaded){
+        if(attempt < MUZZLEY_PLUG_PANEL_RETRIES){
+            //The unit is looked up again when retrying, the session may have been lost meanwhile
+            muzzley_scheduler.After(MUZZLEY_PLUG_PANEL_RETRY_DELAY << attempt, [device_id_str, device_name_str, manufacturer_str, model_number_str, bus_name, attempt] () {
+                ControlPanelControllerUnit* unit = muzzley_get_plug_controlpanelunit(bus_name);
+                if(unit==NULL){
+                    cout << "AnnounceHandler plug " << device_id_str << " went away" << endl << flush;
+                    return;
                 }
-                
-
-            }
+                muzzley_parse_plugs_controlpanelunit(device_id_str, device_name_str, manufacturer_str, model_number_str, bus_name, unit, attempt + 1);
+            });
+            return;
+        }
+        if(!learned){
+            cout << "AnnounceHandler RootContainer of plug " << device_id_str << " not loaded, giving up" << endl << flush;
+            return;
         }
+        //A model without some of the widgets is bound with what it has, and walked again for its next device
+        cout << "AnnounceHandler panel of plug " << device_id_str << " is incomplete, binding the widgets found" << endl << flush;
+    }else if(learned){
+        muzzley_plug_layouts.Set(layout_key, layout);
+    }
+    if(learned){
+        MuzzleyWidgetLayouts::Bind(rootContainer, layout, widgets);
+    }
 
-    del_plug_vector_pos(device_id_str);
-    add_plug_vector_pos(device_id_str, device_name_str, plug_property_status, plug_property_volt, plug_property_curr, plug_property_freq, plug_property_watt , plug_property_accu, plug_action_get_properties, plug_action_on, plug_action_off);
-    muzzley_add_plugs_component(device_id_str, device_name_str);
-    gupnp_generate_plugs_XML();
-    muzzley_plug_vector_print();
+    Property* plug_properties[PLUG_VALUE_COUNT];
+    Action* plug_actions[PLUG_ACTION_COUNT];
+    for (int value = 0; value < PLUG_VALUE_COUNT; value++){
+        plug_properties[value] = (Property*)widgets[value];
+        //Meter readings are cleared until the device reports them
+        if(value!=PLUG_STATUS && plug_properties[value]!=NULL)
+            plug_properties[value]->setValue("");
+    }
+    for (int action = 0; action < PLUG_ACTION_COUNT; action++){
+        plug_actions[action] = (Action*)widgets[PLUG_VALUE_COUNT + action];
+    }
+
+    muzzley_pluglist.Add(device_id_str, device_name_str, plug_properties, plug_actions);
+    muzzley_load_plug_energy(device_id_str);
+
+    //The sampler asks the device for its readings right away, then on its own schedule
+    muzzley_plug_sampler.Watch(device_id_str);
+    muzzley_plugs_sync.Add(device_id_str, device_name_str);
+    muzzley_pluglist_print();
 }
 
 static void announceHandlerCallback(qcc::String const& busName, unsigned short version, unsigned short port, const AnnounceHandler::ObjectDescriptions& objectDescs, const AnnounceHandler::AboutData& aboutData){
@@ -3198,9 +2886,8 @@ static void announceHandlerCallback(qcc::String const& busName, unsigned short v
             std::vector<qcc::String> vector = it->second;
 
             if(key=="/org/allseen/LSF/Lamp"){
-                gupnp_generate_lighting_XML();
                 muzzley_lamplist_update_lampname(device_id_str, device_name_str);
-                muzzley_add_lighting_component(device_id_str, device_name_str);
+                muzzley_lighting_sync.Add(device_id_str, device_name_str);
             }
 
             if(key=="/org/allseen/LSF/ControllerService"){}
@@ -3259,7 +2946,7 @@ static void announceHandlerCallback(qcc::String const& busName, unsigned short v
         //ProxyBusObject pbus_obj = ProxyBusObject(**bus, "SmartPlug", "ControlPanel/SmartPlug/rootContainer", sessionid, false);
         //IntrospectRemoteObjectAsync();
         
-        muzzley_parse_plugs_controlpanelunit(device_id_str, device_name_str, cp_unit);
+        muzzley_parse_plugs_controlpanelunit(device_id_str, device_name_str, manufacturer_str, model_number_str, busName.c_str(), cp_unit);
 
     }catch(exception& e){
         cout << "Exception: " << e.what() << endl << flush;
@@ -3310,9 +2997,61 @@ void upnp_info(string urn, string host, string xml_file_path, int port,
     cout << "MODEL DESCRIPTION: " << modeldescription << endl << endl << flush;
 }
 
+//Releases the description a response body was pointing at
+static void gupnp_description_release(gpointer data){
+    delete (MuzzleyDescription::Snapshot*)data;
+}
+
+//Serves a device description from memory, gzipped when the control point accepts it
+static void gupnp_description_handler(SoupServer* server, SoupMessage* msg, const char* path, GHashTable* query, SoupClientContext* client, gpointer user_data){
+    try{
+        if(msg->method != SOUP_METHOD_GET && msg->method != SOUP_METHOD_HEAD){
+            soup_message_set_status(msg, SOUP_STATUS_NOT_IMPLEMENTED);
+            return;
+        }
+
+        MuzzleyDescription::Snapshot document = ((MuzzleyDescription*)user_data)->GetSnapshot();
+        soup_message_headers_replace(msg->response_headers, "ETag", document->etag.c_str());
+        soup_message_headers_replace(msg->response_headers, "Last-Modified", document->lastModified.c_str());
+        soup_message_headers_replace(msg->response_headers, "Vary", "Accept-Encoding");
+
+        const char* if_none_match = soup_message_headers_get_one(msg->request_headers, "If-None-Match");
+        const char* if_modified_since = soup_message_headers_get_one(msg->request_headers, "If-Modified-Since");
+        if((if_none_match && document->etag == if_none_match) || (!if_none_match && if_modified_since && document->lastModified == if_modified_since)){
+            soup_message_set_status(msg, SOUP_STATUS_NOT_MODIFIED);
+            return;
+        }
+
+        const string* body = &document->xml;
+        const char* accept_encoding = soup_message_headers_get_one(msg->request_headers, "Accept-Encoding");
+        if(accept_encoding && !document->gzip.empty() && soup_header_contains(accept_encoding, "gzip")){
+            soup_message_headers_replace(msg->response_headers, "Content-Encoding", "gzip");
+            body = &document->gzip;
+        }
+        soup_message_headers_set_content_type(msg->response_headers, "text/xml; charset=\"utf-8\"", NULL);
+
+        //The body points into the document, which lives until libsoup releases the buffer
+        SoupBuffer* buffer = soup_buffer_new_with_owner(body->data(), body->size(), new MuzzleyDescription::Snapshot(document), gupnp_description_release);
+        soup_message_body_append_buffer(msg->response_body, buffer);
+        soup_buffer_free(buffer);
+        soup_message_set_status(msg, SOUP_STATUS_OK);
+    }catch(exception& e){
+        cout << "Exception: " << e.what() << endl << flush;
+        soup_message_set_status(msg, SOUP_STATUS_INTERNAL_SERVER_ERROR);
+    }
+}
+
+//Replaces the file handler GUPnP installed for the description of a root device
+void gupnp_serve_description(GUPnPContext* context, GUPnPRootDevice* device, MuzzleyDescription* description){
+    string path = gupnp_root_device_get_relative_location(device);
+    if(path.empty() || path[0] != '/')
+        path = "/" + path;
+    soup_server_add_handler(gupnp_context_get_server(context), path.c_str(), gupnp_description_handler, description, NULL);
+}
+
+//Runs on the scheduler loop, which also dispatches the UPnP sockets and SSDP timers
 void upnp_advertise(){
 
-    GMainLoop *main_loop; 
     GError *error = NULL;
     GUPnPContext *gupnp_lighting_context;
     GUPnPRootDevice *gupnp_lighting_dev;
@@ -3328,16 +3067,17 @@ void upnp_advertise(){
     #endif
   
     //Lighting UPnP
-    gupnp_lighting_context = gupnp_context_new (NULL, muzzley_lighting_upnp_interface.c_str(), muzzley_lighting_upnp_port, &error);
+    gupnp_lighting_context = gupnp_context_new (muzzley_scheduler.GetContext(), muzzley_lighting_upnp_interface.c_str(), muzzley_lighting_upnp_port, &error);
     if (error) {
         g_printerr ("Error creating the GUPnP lighting context: %s\n", error->message);
         g_error_free (error);
-        return EXIT_FAILURE;
+        return;
     }
     
     gupnp_generate_lighting_XML();
 
     gupnp_lighting_dev = gupnp_root_device_new (gupnp_lighting_context, muzzley_lighting_upnp_xml_filename.c_str(), muzzley_lighting_upnp_xml_filepath.c_str());
+    gupnp_serve_description(gupnp_lighting_context, gupnp_lighting_dev, &gupnp_lighting_description);
     gupnp_root_device_set_available (gupnp_lighting_dev, TRUE);
     gupnp_lighting_resource_group = gupnp_root_device_get_ssdp_resource_group(gupnp_lighting_dev);
     gssdp_resource_group_set_max_age (gupnp_lighting_resource_group, GUPNP_MAX_AGE);
@@ -3355,16 +3095,17 @@ void upnp_advertise(){
     muzzley_lighting_upnp_description_path=gupnp_root_device_get_description_path(gupnp_lighting_dev);
 
     //Plugs UPnP
-    gupnp_plugs_context = gupnp_context_new (NULL, muzzley_plugs_upnp_interface.c_str(), muzzley_plugs_upnp_port, &error);
+    gupnp_plugs_context = gupnp_context_new (muzzley_scheduler.GetContext(), muzzley_plugs_upnp_interface.c_str(), muzzley_plugs_upnp_port, &error);
     if (error) {
         g_printerr ("Error creating the GUPnP plugs context: %s\n", error->message);
         g_error_free (error);
-        return EXIT_FAILURE;
+        return;
     }
 
     gupnp_generate_plugs_XML();
 
     gupnp_plugs_dev = gupnp_root_device_new (gupnp_plugs_context, muzzley_plugs_upnp_xml_filename.c_str(), muzzley_plugs_upnp_xml_filepath.c_str());
+    gupnp_serve_description(gupnp_plugs_context, gupnp_plugs_dev, &gupnp_plugs_description);
     gupnp_root_device_set_available (gupnp_plugs_dev, TRUE);
     gupnp_plugs_resource_group = gupnp_root_device_get_ssdp_resource_group(gupnp_plugs_dev);
     gssdp_resource_group_set_max_age (gupnp_plugs_resource_group, GUPNP_MAX_AGE);
@@ -3385,10 +3126,6 @@ void upnp_advertise(){
     //gssdp_resource_group_add_resource_simple(gupnp_plugs_resource_group, plugs_device_urn_char, plugs_device_urn_char , plugs_host_char );
     //gssdp_resource_group_set_available (gupnp_lighting_resource_group, TRUE);
     //gssdp_resource_group_set_available (gupnp_plugs_resource_group, TRUE);
-
-    //Run the main loop
-    main_loop = g_main_loop_new (NULL, FALSE);
-    g_main_loop_run (main_loop);
 }
 
 
@@ -3431,6 +3168,13 @@ void cmd_line_parser_help(){
     cout << "--model-number                 set the UPnP Model Number" << endl << flush;
     cout << "--model-description            set the UPnP Model Description string" << endl << flush;
     cout << "--ignore-onbehalfof            ignore requests on behalf of" << endl << flush;
+    cout << "--state-cache-ttl              set the seconds a cached lamp state answers reads (0 disables)" << endl << flush;
+    cout << "--write-window                 set the milliseconds between two writes to a lamp" << endl << flush;
+    cout << "--publish-batch-window         set the milliseconds publishes wait to share a frame (0 disables)" << endl << flush;
+    cout << "--component-sync-window        set the milliseconds component changes are collected before they are sent" << endl << flush;
+    cout << "--brightness-threshold         set the smallest brightness change published (0-1)" << endl << flush;
+    cout << "--color-threshold              set the smallest color channel change published" << endl << flush;
+    cout << "--energy-directory             set the directory plug power and energy history is kept in" << endl << flush;
     cout << "--help                         show this help text" << endl << endl << flush;
 }
 
@@ -3443,66 +3187,43 @@ void muzzley_info_print(){
     cout << "MANAGER PORT: " << muzzley_manager_port << endl << flush;
     cout << "LIGHTING PROFILEID: " << muzzley_lighting_profileid << endl << flush;
     cout << "LIGHTING APPTOKEN: " << muzzley_lighting_apptoken << endl << flush;
-    cout << "LIGHTING CHANNEL ID: " << muzzley_lighting_deviceKey << endl << flush;
+    cout << "LIGHTING CHANNEL ID: " << muzzley_get_deviceKey(muzzley_lighting_deviceKey) << endl << flush;
     cout << "LIGHTING SESSION ID: " << muzzley_lighting_sessionid << endl << flush;
     cout << "LIGHTING FRIENDLYNAME: " << muzzley_lighting_upnp_friendlyname << endl << flush;
     cout << "PLUGS PROFILEID: " << muzzley_plugs_profileid << endl << flush;
     cout << "PLUGS APPTOKEN: " << muzzley_plugs_apptoken << endl << flush;
-    cout << "PLUGS CHANNEL ID: " << muzzley_plugs_deviceKey << endl << flush;
+    cout << "PLUGS CHANNEL ID: " << muzzley_get_deviceKey(muzzley_plugs_deviceKey) << endl << flush;
     cout << "PLUGS SESSION ID: " << muzzley_plugs_sessionid<< endl << flush;
     cout << "PLUGS FRIENDLYNAME: " << muzzley_plugs_upnp_friendlyname << endl << flush;
     cout << "COLOR MODE: " << muzzley_color_mode << endl << flush;
     cout << "WORKERS: " << boolalpha << muzzley_OnBehalfOf << endl << endl << flush;
 }
 
-void alljoyn_status_info(){
-    while(true){
-        //Update XML Data
-        gupnp_generate_lighting_XML();
-        gupnp_generate_plugs_XML();
-        //Print Info
-        muzzley_info_print();
-        upnp_info_print();
-        lsf_controller_client_print();
-        lsf_controller_service_print();
-        muzzley_lamplist_print();
-        muzzley_plug_vector_print();
-        sleep(MUZZLEY_DEFAULT_STATUS_INTERVAL);
-    }
+bool alljoyn_status_info(){
+    //Update XML Data, nothing is written unless it changed
+    gupnp_generate_lighting_XML();
+    gupnp_generate_plugs_XML();
+    //Print Info
+    muzzley_info_print();
+    upnp_info_print();
+    lsf_controller_client_print();
+    lsf_controller_service_print();
+    muzzley_lamplist_print();
+    muzzley_pluglist_print();
+    return true;
 }
 
-void muzzley_read_request_cleaner(){
-    while(true){
-        muzzley_clean_request_vector();
-    }
+bool muzzley_read_request_cleaner(){
+    muzzley_clean_request_table();
+    return true;
 }
 
-void muzzley_update_lamplist(LampManager* lampManager){
-    while(true){
-        //Update lampList
-        int status = lampManager->GetAllLampIDs();
-        usleep(LSF_LAMPMANAGER_SLEEP);
-        muzzley_query_unknown_lampnames(lampManager);
-        sleep(MUZZLEY_DEFAULT_STATUS_INTERVAL);
-    }
+void muzzley_shutdown(){
+    cout << "Stopping Alljoyn-Muzzley Connector..." << endl << flush;
+    muzzley_scheduler.Stop();
 }
 
 int main(int argc, char* argv[]){
-    
-
-    // Adds listeners for SIGKILL, for gracefull stop
-    // It will be invoked when the user hits Ctrl-c
-    // For a list of allocated sempahores (and other shared resources), execute the 'ipcs' command on a tty
-    struct sigaction action;
-    action.sa_handler = semaphore_stop;
-    sigemptyset(&action.sa_mask);
-    action.sa_flags = 0;
-    sigaction(SIGTERM, &action, 0);
-    sigaction(SIGQUIT, &action, 0);
-    sigaction(SIGINT, &action, 0);
-
-    //Muzzley Client
-    muzzley::Client _muzzley_lighting_client;
 
     //Set default Muzzley tokens
     muzzley_color_mode=PROPERTY_COLOR_HSV;
@@ -3544,6 +3265,13 @@ int main(int argc, char* argv[]){
 
     muzzley_OnBehalfOf = true;
 
+    //Smallest changes worth publishing right away, smaller ones wait to settle
+    muzzley_lamp_deltas.SetHandler(muzzley_publish_lamp_settled);
+    muzzley_lamp_deltas.SetThreshold(PROPERTY_BRIGHTNESS, MUZZLEY_DEFAULT_BRIGHTNESS_THRESHOLD);
+    muzzley_lamp_deltas.SetThreshold(PROPERTY_COLOR_RGB, MUZZLEY_DEFAULT_COLOR_THRESHOLD);
+    muzzley_lamp_deltas.SetThreshold(PROPERTY_COLOR_HSV, MUZZLEY_DEFAULT_COLOR_THRESHOLD);
+    muzzley_lamp_deltas.SetThreshold(PROPERTY_COLOR_HSVT, MUZZLEY_DEFAULT_COLOR_THRESHOLD);
+
     //Parse cmd line custom Muzzley tokens
     if(argc>1){
         for (int i = 1; i < argc; i++) {
@@ -3618,6 +3346,24 @@ int main(int argc, char* argv[]){
                 muzzley_modeldescription = argv[i + 1];
             } else if (strcmp(argv[i], "--ignore-onbehalfof")==0) {
                 muzzley_OnBehalfOf = false;
+            } else if (strcmp(argv[i], "--state-cache-ttl")==0) {
+                muzzley_lamp_cache.SetTTL(atoi(argv[i + 1]));
+            } else if (strcmp(argv[i], "--write-window")==0) {
+                muzzley_lamp_writes.SetWindow(atoi(argv[i + 1]));
+            } else if (strcmp(argv[i], "--publish-batch-window")==0) {
+                muzzley_lighting_publisher.SetBatchWindow(atoi(argv[i + 1]));
+                muzzley_plugs_publisher.SetBatchWindow(atoi(argv[i + 1]));
+            } else if (strcmp(argv[i], "--component-sync-window")==0) {
+                muzzley_lighting_sync.SetWindow(atoi(argv[i + 1]));
+                muzzley_plugs_sync.SetWindow(atoi(argv[i + 1]));
+            } else if (strcmp(argv[i], "--brightness-threshold")==0) {
+                muzzley_lamp_deltas.SetThreshold(PROPERTY_BRIGHTNESS, atof(argv[i + 1]));
+            } else if (strcmp(argv[i], "--color-threshold")==0) {
+                muzzley_lamp_deltas.SetThreshold(PROPERTY_COLOR_RGB, atof(argv[i + 1]));
+                muzzley_lamp_deltas.SetThreshold(PROPERTY_COLOR_HSV, atof(argv[i + 1]));
+                muzzley_lamp_deltas.SetThreshold(PROPERTY_COLOR_HSVT, atof(argv[i + 1]));
+            } else if (strcmp(argv[i], "--energy-directory")==0) {
+                muzzley_plug_energy.SetDirectory(argv[i + 1]);
             } else if (strcmp(argv[i], "--help")==0) {
                 cmd_line_parser_help();
                 exit(0);
@@ -3637,15 +3383,56 @@ int main(int argc, char* argv[]){
     muzzley_lighting_upnp_serialnumber = sha256(muzzley_lighting_macAddress);
     muzzley_plugs_upnp_serialnumber = sha256(muzzley_plugs_macAddress);
 
-    //set the semaphore filename
-    muzzley_semaphore_filename=muzzley_lighting_profileid+muzzley_plugs_profileid + ".sem";
-    muzzley_write_semaphore_file();
-
     //set the DeviceKey filename accordingly with the respective profile id
     muzzley_lighting_deviceKey_filename=muzzley_lighting_profileid;
     muzzley_lighting_deviceKey_filename=muzzley_lighting_deviceKey_filename + ".key";
+    muzzley_lighting_components_filename=muzzley_lighting_profileid + ".components";
     muzzley_plugs_deviceKey_filename=muzzley_plugs_profileid;
     muzzley_plugs_deviceKey_filename=muzzley_plugs_deviceKey_filename + ".key";
+    muzzley_plugs_components_filename=muzzley_plugs_profileid + ".components";
+
+    //set the cached profile filename accordingly with the respective profile id
+    muzzley_lighting_thing_filename=muzzley_lighting_profileid + ".thing";
+    muzzley_plugs_thing_filename=muzzley_plugs_profileid + ".thing";
+
+    //set UPNP filename with the Muzzley profileid
+    muzzley_lighting_upnp_xml_filename=muzzley_lighting_profileid + ".xml";
+    muzzley_plugs_upnp_xml_filename=muzzley_plugs_profileid + ".xml";
+
+    //set what each profile registers with
+    lighting_registration.name = "lighting";
+    lighting_registration.profileid = &muzzley_lighting_profileid;
+    lighting_registration.apptoken = &muzzley_lighting_apptoken;
+    lighting_registration.deviceKey = &muzzley_lighting_deviceKey;
+    lighting_registration.nextDeviceKey = &muzzley_lighting_next_deviceKey;
+    lighting_registration.deviceKey_filename = &muzzley_lighting_deviceKey_filename;
+    lighting_registration.thing_filename = &muzzley_lighting_thing_filename;
+    lighting_registration.components_filename = &muzzley_lighting_components_filename;
+    lighting_registration.macAddress = &muzzley_lighting_macAddress;
+    lighting_registration.serialnumber = &muzzley_lighting_upnp_serialnumber;
+    lighting_registration.friendlyname = &muzzley_lighting_upnp_friendlyname;
+    lighting_registration.thing = &lighting_thing;
+    lighting_registration.registered = &muzzley_lighting_registered;
+    lighting_registration.ledger = &muzzley_lighting_ledger;
+    lighting_registration.client = &_muzzley_lighting_client;
+    lighting_registration.publisher = &muzzley_lighting_publisher;
+
+    plugs_registration.name = "plugs";
+    plugs_registration.profileid = &muzzley_plugs_profileid;
+    plugs_registration.apptoken = &muzzley_plugs_apptoken;
+    plugs_registration.deviceKey = &muzzley_plugs_deviceKey;
+    plugs_registration.nextDeviceKey = &muzzley_plugs_next_deviceKey;
+    plugs_registration.deviceKey_filename = &muzzley_plugs_deviceKey_filename;
+    plugs_registration.thing_filename = &muzzley_plugs_thing_filename;
+    plugs_registration.components_filename = &muzzley_plugs_components_filename;
+    plugs_registration.macAddress = &muzzley_plugs_macAddress;
+    plugs_registration.serialnumber = &muzzley_plugs_upnp_serialnumber;
+    plugs_registration.friendlyname = &muzzley_plugs_upnp_friendlyname;
+    plugs_registration.thing = &plugs_thing;
+    plugs_registration.registered = &muzzley_plugs_registered;
+    plugs_registration.ledger = &muzzley_plugs_ledger;
+    plugs_registration.client = &_muzzley_plugs_client;
+    plugs_registration.publisher = &muzzley_plugs_publisher;
 
     //set the UPNP UDN accordingly with the respective profile id
     muzzley_lighting_upnp_udn=muzzley_lighting_profileid;
@@ -3675,6 +3462,11 @@ int main(int argc, char* argv[]){
     ControllerClient client(*bus, controllerClientCBHandler);
     ControllerServiceManager controllerServiceManager(client, controllerServiceManagerCBHandler); 
     LampManager lampManager(client, lampManagerCBHandler);
+
+    //Names are renamed in the lamplist and sent to muzzley once per batch
+    muzzley_name_resolver.SetHandlers([&lampManager] (const string& lampID) -> bool {
+        return lampManager.GetLampName(lampID) == LSF_OK;
+    }, muzzley_apply_lighting_names);
     
 
     
@@ -3684,12 +3476,13 @@ int main(int argc, char* argv[]){
     
     _muzzley_lighting_client.on(muzzley::AppLoggedIn,[&lampManager] (muzzley::Message& _data, muzzley::Client& _muzzley_lighting_client) -> bool{
         muzzley_lighting_sessionid = (string)_data["d"]["sessionId"];
+        muzzley_login_deviceKey(&lighting_registration);
         //cout << "Lighting logged in with session id: " << muzzley_lighting_sessionid << endl << endl << flush;
 
         muzzley::Subscription _s1;
         _s1.setNamespace(MUZZLEY_WORKSPACE);
         _s1.setProfile(muzzley_lighting_profileid);
-        _s1.setChannel(muzzley_lighting_deviceKey);
+        _s1.setChannel(muzzley_get_deviceKey(muzzley_lighting_deviceKey));
         //_s1.setComponent("*");
         //_s1.setProperty("*");
 
@@ -3713,12 +3506,13 @@ int main(int argc, char* argv[]){
 
     _muzzley_plugs_client.on(muzzley::AppLoggedIn,[] (muzzley::Message& _data, muzzley::Client& _muzzley_plugs_client) -> bool{
         muzzley_plugs_sessionid = (string)_data["d"]["sessionId"];
+        muzzley_login_deviceKey(&plugs_registration);
         //cout << "Plugs logged in with session id: " << muzzley_plugs_sessionid << endl << endl << flush;
        
         muzzley::Subscription _s1;
         _s1.setNamespace(MUZZLEY_WORKSPACE);
         _s1.setProfile(muzzley_plugs_profileid);
-        _s1.setChannel(muzzley_plugs_deviceKey);
+        _s1.setChannel(muzzley_get_deviceKey(muzzley_plugs_deviceKey));
         //_s1.setComponent("*");
         //_s1.setProperty("*");
 
@@ -3750,90 +3544,39 @@ int main(int argc, char* argv[]){
         return true;
     });
    
+    //Registration threads, joined before the globals they use are torn down
+    std::vector<std::thread> register_threads;
 
     try{
-        // Waits for global manager lighting devicekey
-        while(!muzzley_lighting_registered){
-            cout << endl << "Waiting for Muzzley lighting registration..." << endl << flush;
-            
-            muzzley::HTTPRep _rep = muzzley_send_api_http_request(muzzley_api_endpointhost, muzzley_api_port, muzzley_lighting_profileid);
-            if (_rep->status() == muzzley::HTTP200 || _rep->status() == muzzley::HTTP201) {
-                lighting_thing = muzzley_parse_api_http_reply(_rep);
-                
-                //Read the device key from file
-                muzzley_lighting_deviceKey=muzzley_read_lighting_deviceKey_file();
-                cout << "File lighting device key: " << muzzley_lighting_deviceKey << endl << flush;
+        //A registration cached by a previous run is used right away and revalidated in the background
+        bool lighting_cached = muzzley_load_registration(&lighting_registration);
+        bool plugs_cached = muzzley_load_registration(&plugs_registration);
 
-                muzzley::HTTPRep _rep = muzzley_send_globalmanager_http_request(muzzley_manager_endpointhost, muzzley_manager_port, muzzley_lighting_profileid, muzzley_lighting_deviceKey, muzzley_lighting_macAddress, muzzley_lighting_upnp_serialnumber, muzzley_lighting_upnp_friendlyname);
-                if (_rep->status() == muzzley::HTTP200 || _rep->status() == muzzley::HTTP201) {
-                    // Print the value of a message header
-                    muzzley::JSONObj _key = (muzzley::JSONObj&) muzzley::fromstr(_rep->body());
-                    cout << endl << "Parsed Global Manager Reply:" << endl << "Lighting deviceKey: " << (string)_key["deviceKey"] << endl << endl << flush;
-                    
-                    //Store deviceKey in a file
-                    muzzley_lighting_deviceKey = (string)_key["deviceKey"];
-                    muzzley_write_lighting_deviceKey_file(muzzley_lighting_deviceKey);
-                    muzzley_lighting_registered=true;
+        //Component changes are sent by their own worker threads
+        muzzley_lighting_sync.Start(muzzley_sync_lighting_components);
+        muzzley_plugs_sync.Start(muzzley_sync_plugs_components);
 
-                    //set UPNP filename with the Muzzley profileid
-                    muzzley_lighting_upnp_xml_filename=muzzley_lighting_profileid + ".xml";
+        //Plug readings are requested by their own worker thread
+        muzzley_plug_sampler.Start(muzzley_sample_plug);
 
-                }
-                else{
-                    cout << "Error: " << _rep->status() << endl << flush;
-                    cout << _rep->body() << endl << endl << flush;
-                }
-                sleep(1);
-            }else{
-                cout << "Error: " << _rep->status() << endl << flush; 
-                cout << _rep->body() << endl << endl << flush;
-            }            
+        //Connects the cached applications to the Muzzley server, the others connect once registered.
+        //Each client is written by its own sender thread, started with the application so publishes
+        //queued by the AllJoyn discovery wait for it
+        if(lighting_cached){
+            _muzzley_lighting_client.initApp(muzzley_lighting_apptoken);
+            muzzley_lighting_publisher.Start(&_muzzley_lighting_client);
+            cout << "Muzzley lighting started!" << endl << flush;
         }
-
-        // Waits for global manager plugs devicekey
-        while(!muzzley_plugs_registered){
-            cout << endl << "Waiting for Muzzley plugs registration..." << endl << flush;
-            muzzley::HTTPRep _rep = muzzley_send_api_http_request(muzzley_api_endpointhost, muzzley_api_port, muzzley_plugs_profileid);
-            if (_rep->status() == muzzley::HTTP200 || _rep->status() == muzzley::HTTP201) {
-                plugs_thing = muzzley_parse_api_http_reply(_rep);
-
-                //Read the device key from file
-                muzzley_plugs_deviceKey=muzzley_read_plugs_deviceKey_file();
-                cout << "File plugs device key: " << muzzley_plugs_deviceKey << endl << flush;
-
-                muzzley::HTTPRep _rep = muzzley_send_globalmanager_http_request(muzzley_manager_endpointhost, muzzley_manager_port, muzzley_plugs_profileid, muzzley_plugs_deviceKey, muzzley_plugs_macAddress, muzzley_plugs_upnp_serialnumber, muzzley_plugs_upnp_friendlyname);
-                if (_rep->status() == muzzley::HTTP200 || _rep->status() == muzzley::HTTP201) {
-                    // Print the value of a message header
-                    muzzley::JSONObj _key = (muzzley::JSONObj&) muzzley::fromstr(_rep->body());
-                    cout << endl << "Parsed Global Manager Reply:" << endl << "Plugs deviceKey: " << (string)_key["deviceKey"] << endl << endl << flush;
-                    
-                    //Store deviceKey in a file
-                    muzzley_plugs_deviceKey = (string)_key["deviceKey"];
-                    muzzley_write_plugs_deviceKey_file(muzzley_plugs_deviceKey);
-                    muzzley_plugs_registered=true;
-
-                    //set UPNP filename with the Muzzley profileid
-                    muzzley_plugs_upnp_xml_filename=muzzley_plugs_profileid + ".xml";
-
-                }
-                else{
-                    cout << "Error: " << _rep->status() << endl << flush;
-                    cout << _rep->body() << endl << endl << flush;
-                }
-                sleep(1);
-            }else{
-                cout << "Error: " << _rep->status() << endl << flush;
-                cout << _rep->body() << endl << endl << flush;
-            }
+        if(plugs_cached){
+            _muzzley_plugs_client.initApp(muzzley_plugs_apptoken);
+            muzzley_plugs_publisher.Start(&_muzzley_plugs_client);
+            cout << "Muzzley plugs started!" << endl << flush;
         }
 
-        //Connects the application to the Muzzley server.
-        _muzzley_lighting_client.initApp(muzzley_lighting_apptoken);
-        cout << "Muzzley lighting started!" << endl << flush;
-
-        //Connects the application to the Muzzley server.
-        _muzzley_plugs_client.initApp(muzzley_plugs_apptoken);
-        cout << "Muzzley plugs started!" << endl << flush;
+        //Registers all profiles at the same time
+        muzzley_registering = true;
+        register_threads.push_back(std::thread(muzzley_register, &lighting_registration, muzzley_read_deviceKey_file(muzzley_lighting_deviceKey_filename)));
+        register_threads.push_back(std::thread(muzzley_register, &plugs_registration, muzzley_read_deviceKey_file(muzzley_plugs_deviceKey_filename)));
 
 
         ControllerClientStatus status = client.Start();
@@ -3863,6 +3606,9 @@ int main(int argc, char* argv[]){
         
         controlPanelController = new ControlPanelController();
         controlPanelListener = new ControlPanelListenerImpl(controlPanelController);
+        controlPanelListener->setPropertyChangedHandler([] (ControlPanelDevice* device, Property* property) {
+            muzzley_handle_plug_property_changed(property);
+        });
         bus_status = controlPanelService->initController(bus, controlPanelController, controlPanelListener);
         if (bus_status != ER_OK) {
             std::cout << "Could not initialize Controllee." << std::endl;
@@ -3882,28 +3628,57 @@ int main(int argc, char* argv[]){
             //return 1;
         }
 
-        //Starts the UPNP advertisement
-        std::thread upnp_thread(upnp_advertise);
-        upnp_thread.detach();
+        //Starts the UPNP advertisement once the scheduler loop runs, the devices live on its context
+        muzzley_scheduler.Post(upnp_advertise);
 
         //Lists all alljoyn devices periodically
-        std::thread alljoyn_status_thread(alljoyn_status_info);
-        alljoyn_status_thread.detach();
+        muzzley_scheduler.Post(alljoyn_status_info);
+        muzzley_scheduler.EverySeconds(MUZZLEY_DEFAULT_STATUS_INTERVAL, alljoyn_status_info);
 
         //Cleans all timmed out muzzley read requsts
-        std::thread muzzley_read_request_cleaner_thread(muzzley_read_request_cleaner);
-        muzzley_read_request_cleaner_thread.detach();
+        muzzley_scheduler.EverySeconds(MUZZLEY_READ_REQUEST_CLEANER_INTERVAL, muzzley_read_request_cleaner);
+
+        //Closes idle HTTP connections
+        muzzley_scheduler.EverySeconds(MUZZLEY_HTTP_IDLE_TIMEOUT, [] () -> bool {
+            muzzley_http_pool.Evict();
+            return true;
+        });
+
+        //Plug readings go to the history every second, whether or not they changed
+        muzzley_scheduler.EverySeconds(MUZZLEY_METER_RECORD_INTERVAL, muzzley_record_plug_readings);
+
+        //Plug readings are written to disk a minute at a time
+        muzzley_scheduler.EverySeconds(MUZZLEY_ENERGY_INTERVAL, muzzley_store_plug_energy);
 
         //Update Alljoyn lamp list
-        std::thread muzzley_update_lamplist_thread(muzzley_update_lamplist, &lampManager);
-        muzzley_update_lamplist_thread.detach();
+        muzzley_update_lamplist(&lampManager);
+        muzzley_scheduler.EverySeconds(MUZZLEY_DEFAULT_STATUS_INTERVAL, [&lampManager] () -> bool {
+            muzzley_update_lamplist(&lampManager);
+            return true;
+        });
 
-        while(true){}
-    
-        cleanup();
+        //Stops the scheduler loop on Ctrl-c for a clean shutdown
+        muzzley_scheduler.OnSignal(SIGINT, muzzley_shutdown);
+        muzzley_scheduler.OnSignal(SIGTERM, muzzley_shutdown);
+
+        muzzley_scheduler.Run();
+
+        //The registration threads use the HTTP pool and the scheduler, they go first
+        muzzley_stop_registering(register_threads);
+
+        //The bus is still referenced by the lighting managers, so it is not deleted here
+        client.Stop();
+        muzzley_plug_sampler.Stop();
+        muzzley_lighting_publisher.Stop();
+        muzzley_plugs_publisher.Stop();
+        muzzley_lighting_sync.Stop();
+        muzzley_plugs_sync.Stop();
+        muzzley_http_pool.Clear();
+        muzzley_plug_energy.Close();
 
     }catch(exception& e){
         cout << "Error: " << e.what() << endl << flush;
+        muzzley_stop_registering(register_threads);
         return true;
     }
 
@@ -19,6 +19,7 @@
 
 #include <alljoyn/controlpanel/ControlPanelListener.h>
 #include <alljoyn/controlpanel/ControlPanelController.h>
+#include <functional>
 
 /*
  *
@@ -26,8 +27,18 @@
 class ControlPanelListenerImpl : public ajn::services::ControlPanelListener {
   public:
 
+    /**
+     * Runs on the AllJoyn thread that received a change signal for a property widget
+     */
+    typedef std::function<void (ajn::services::ControlPanelDevice* device, ajn::services::Property* property)> PropertyChanged;
+
     ControlPanelListenerImpl(ajn::services::ControlPanelController* controller);
 
+    /**
+     * Set before the controller is started, signals for other widgets are only printed
+     */
+    void setPropertyChangedHandler(PropertyChanged handler);
+
     ~ControlPanelListenerImpl();
 
     void sessionEstablished(ajn::services::ControlPanelDevice* device);
@@ -49,6 +60,8 @@ class ControlPanelListenerImpl : public ajn::services::ControlPanelListener {
 
     std::vector<qcc::String> m_ConnectedDevices;
 
+    PropertyChanged m_PropertyChanged;
+
 };
 
 #endif /* CONTROLPANELLISTENERIMPL_H_ */
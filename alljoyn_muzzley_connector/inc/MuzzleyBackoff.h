@@ -0,0 +1,65 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef MUZZLEYBACKOFF_H_
+#define MUZZLEYBACKOFF_H_
+
+#include <random>
+
+/**
+ * Exponential backoff with jitter.
+ * Each delay is drawn between half and all of the current step, and the
+ * step doubles up to a maximum, so retries of several clients spread out
+ * instead of hitting the server together.
+ */
+class MuzzleyBackoff {
+  public:
+
+    /**
+     * Constructor
+     * @param initial - milliseconds of the first step
+     * @param maximum - milliseconds the step never exceeds
+     */
+    MuzzleyBackoff(unsigned int initial, unsigned int maximum);
+
+    /**
+     * Destructor
+     */
+    ~MuzzleyBackoff();
+
+    /**
+     * Milliseconds to wait before the next attempt
+     */
+    unsigned int Next();
+
+    /**
+     * Start over from the initial step
+     */
+    void Reset();
+
+  private:
+
+    unsigned int initial;
+
+    unsigned int maximum;
+
+    unsigned int step;
+
+    std::mt19937 random;
+};
+
+#endif /* MUZZLEYBACKOFF_H_ */
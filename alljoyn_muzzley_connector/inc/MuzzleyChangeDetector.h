@@ -0,0 +1,118 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef MUZZLEYCHANGEDETECTOR_H_
+#define MUZZLEYCHANGEDETECTOR_H_
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "MuzzleyScheduler.h"
+
+/**
+ * Last value published for each component property. A new value is only
+ * worth publishing when one of its fields moved at least the threshold
+ * set for the property away from the published one. A smaller change is
+ * held, and handed to the settled handler once no other value came for the
+ * quiet period, so the value a slow change ends on is still published.
+ */
+class MuzzleyChangeDetector {
+  public:
+
+    /**
+     * Receives a held value that settled, it is recorded as published
+     */
+    typedef std::function<void (const std::string& component, const std::string& property, const double* fields, unsigned int count)> Settled;
+
+    /**
+     * Most fields a property value has (h, s, v, t)
+     */
+    static const unsigned int MAX_FIELDS = 4;
+
+    /**
+     * Constructor
+     * @param quiet - milliseconds without a new value before a held one settles
+     * @param defer - timer used for the quiet period
+     */
+    MuzzleyChangeDetector(unsigned int quiet, MuzzleyScheduler::Defer defer);
+
+    /**
+     * Destructor
+     */
+    ~MuzzleyChangeDetector();
+
+    /**
+     * Set the smallest change of any field of property that is published.
+     * Properties without a threshold publish on any change.
+     */
+    void SetThreshold(const std::string& property, double threshold);
+
+    /**
+     * Set where settled values go
+     */
+    void SetHandler(Settled settled);
+
+    /**
+     * Check a new value of component property against the published one.
+     * When it changed enough it is recorded as the published value.
+     * @return true if the value must be published
+     */
+    bool Changed(const std::string& component, const std::string& property, const double* fields, unsigned int count);
+
+    /**
+     * Single field version of Changed
+     */
+    bool Changed(const std::string& component, const std::string& property, double value);
+
+    /**
+     * Forget the published values of a component, so that every property
+     * is published again on its next change
+     */
+    void Forget(const std::string& component);
+
+  private:
+
+    struct Value {
+        double fields[MAX_FIELDS];
+        unsigned int count;
+        /**
+         * A change below the threshold waits for the quiet period
+         */
+        bool holding;
+        double held[MAX_FIELDS];
+        unsigned int change;
+    };
+
+    typedef std::unordered_map<std::string, Value> PropertyValues;
+
+    void Settle(const std::string& component, const std::string& property, unsigned int change);
+
+    unsigned int quiet;
+
+    MuzzleyScheduler::Defer defer;
+
+    Settled settled;
+
+    std::unordered_map<std::string, double> thresholds;
+
+    std::unordered_map<std::string, PropertyValues> published;
+
+    std::mutex lock;
+};
+
+#endif /* MUZZLEYCHANGEDETECTOR_H_ */
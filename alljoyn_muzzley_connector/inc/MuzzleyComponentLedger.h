@@ -0,0 +1,85 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef MUZZLEYCOMPONENTLEDGER_H_
+#define MUZZLEYCOMPONENTLEDGER_H_
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "MuzzleyComponentSync.h"
+
+/**
+ * The component set the global manager acknowledged for a device. It is
+ * kept in a file next to the device key, so after a restart changes that
+ * would not alter the acknowledged set are dropped instead of uploaded
+ * again. The file carries a sha256 of the sorted id/label pairs, a file
+ * that does not match it is discarded on Load.
+ */
+class MuzzleyComponentLedger {
+  public:
+
+    /**
+     * Constructor
+     */
+    MuzzleyComponentLedger();
+
+    /**
+     * Destructor
+     */
+    ~MuzzleyComponentLedger();
+
+    /**
+     * Load the set acknowledged for deviceKey from filename. A file written
+     * for another device key is ignored.
+     */
+    void Load(const std::string& filename, const std::string& deviceKey);
+
+    /**
+     * Drop the changes that would not alter the acknowledged set
+     * @return true if any change is left
+     */
+    bool Filter(std::vector<MuzzleyComponent>& upserts, std::vector<MuzzleyComponent>& removes) const;
+
+    /**
+     * The manager acknowledged the changes, apply and save them
+     */
+    void Commit(const std::vector<MuzzleyComponent>& upserts, const std::vector<MuzzleyComponent>& removes);
+
+  private:
+
+    typedef std::map<std::string, std::string> Components;
+
+    static std::string Fingerprint(const Components& components);
+
+    static void Apply(Components& components, const std::vector<MuzzleyComponent>& upserts, const std::vector<MuzzleyComponent>& removes);
+
+    void Save();
+
+    std::string filename;
+
+    std::string deviceKey;
+
+    Components acknowledged;
+
+    std::string fingerprint;
+
+    mutable std::mutex lock;
+};
+
+#endif /* MUZZLEYCOMPONENTLEDGER_H_ */
@@ -0,0 +1,123 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef MUZZLEYCOMPONENTSYNC_H_
+#define MUZZLEYCOMPONENTSYNC_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * A component of a muzzley device, as sent to the global manager
+ */
+struct MuzzleyComponent {
+    std::string id;
+    std::string label;
+};
+
+/**
+ * Component changes on their way to the global manager.
+ * Adds, renames and removes are collected for a debounce window and handed
+ * to Send in one batch from a worker thread, so callers never wait for the
+ * HTTP requests. Changes to the same component are merged, the last one
+ * wins. A batch that could not be sent is merged back under newer changes
+ * and retried.
+ */
+class MuzzleyComponentSync {
+  public:
+
+    /**
+     * Sends a batch, returns false to have it retried
+     */
+    typedef std::function<bool (const std::vector<MuzzleyComponent>& upserts, const std::vector<MuzzleyComponent>& removes)> Send;
+
+    /**
+     * Constructor
+     * @param window - milliseconds changes are collected before a batch is sent
+     * @param retry - milliseconds before a failed batch is sent again
+     */
+    MuzzleyComponentSync(unsigned int window, unsigned int retry);
+
+    /**
+     * Destructor, stops the worker thread
+     */
+    ~MuzzleyComponentSync();
+
+    /**
+     * Start the worker thread, batches are handed to send
+     */
+    void Start(Send send);
+
+    /**
+     * Send what is pending and stop the worker thread
+     */
+    void Stop();
+
+    /**
+     * Add a component, or rename it
+     */
+    void Add(const std::string& id, const std::string& label);
+
+    /**
+     * Remove a component
+     */
+    void Remove(const std::string& id, const std::string& label = "");
+
+    /**
+     * Set the debounce window in milliseconds
+     */
+    void SetWindow(unsigned int window);
+
+  private:
+
+    struct Change {
+        bool remove;
+        std::string label;
+    };
+
+    typedef std::map<std::string, Change> Changes;
+
+    void Queue(const std::string& id, bool remove, const std::string& label);
+
+    bool Flush(Changes& batch);
+
+    void Run();
+
+    unsigned int window;
+
+    unsigned int retry;
+
+    Send send;
+
+    Changes pending;
+
+    bool running;
+
+    std::thread worker;
+
+    std::mutex lock;
+
+    std::condition_variable wakeup;
+};
+
+#endif /* MUZZLEYCOMPONENTSYNC_H_ */
@@ -0,0 +1,128 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef MUZZLEYDESCRIPTION_H_
+#define MUZZLEYDESCRIPTION_H_
+
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * UPnP device description of a muzzley device, kept in memory.
+ * Setting the device fields or the components marks it dirty only when
+ * something differs. Write serializes a dirty description and replaces the
+ * file through a temporary file and a rename, and only when the content
+ * hash differs from what is already on disk. The serialized document is
+ * also kept gzipped, with its ETag and Last-Modified, to be served from
+ * memory.
+ */
+class MuzzleyDescription {
+  public:
+
+    /**
+     * A component element of the description
+     */
+    struct Component {
+        std::string id;
+        std::string label;
+        std::string type;
+    };
+
+    /**
+     * Ordered element name/value pairs of the device element
+     */
+    typedef std::vector<std::pair<std::string, std::string> > Fields;
+
+    /**
+     * A serialized description, never modified once published
+     */
+    struct Document {
+        std::string xml;
+        std::string gzip;
+        std::string etag;
+        std::string lastModified;
+    };
+
+    typedef std::shared_ptr<const Document> Snapshot;
+
+    /**
+     * Constructor
+     */
+    MuzzleyDescription();
+
+    /**
+     * Destructor
+     */
+    ~MuzzleyDescription();
+
+    /**
+     * Set the elements of the device, before the components
+     * @return true if they changed
+     */
+    bool SetDevice(const Fields& fields);
+
+    /**
+     * Set every component of the device
+     * @return true if they changed
+     */
+    bool SetComponents(const std::vector<Component>& components);
+
+    /**
+     * Write the description to filename if it is not there already
+     * @return true if the file was replaced
+     */
+    bool Write(const std::string& filename);
+
+    /**
+     * The serialized description, ready to be served
+     */
+    Snapshot GetSnapshot();
+
+  private:
+
+    void Serialize();
+
+    static void Escape(std::string& out, const std::string& value);
+
+    static std::string Compress(const std::string& data);
+
+    static std::string HTTPDate(time_t time);
+
+    Fields fields;
+
+    std::vector<Component> components;
+
+    bool dirty;
+
+    std::string xml;
+
+    std::string hash;
+
+    Snapshot snapshot;
+
+    std::string writtenFile;
+
+    std::string writtenHash;
+
+    std::mutex lock;
+};
+
+#endif /* MUZZLEYDESCRIPTION_H_ */
@@ -0,0 +1,159 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef MUZZLEYENERGYSTORE_H_
+#define MUZZLEYENERGYSTORE_H_
+
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * A plug reading as laid out in the energy files. Records are 16 bytes, so
+ * they never straddle a page of the mapping and are read in place.
+ */
+struct MuzzleyEnergyRecord {
+    /**
+     * Seconds after the previous record, or the absolute time of a checkpoint
+     */
+    uint32_t time;
+    uint16_t flags;
+    /**
+     * Tells a record that reached the disk from a torn or stale one
+     */
+    uint16_t check;
+    float power;
+    float energy;
+};
+
+/**
+ * A plug reading with its absolute time
+ */
+struct MuzzleyEnergySample {
+    time_t time;
+    float power;
+    float energy;
+};
+
+/**
+ * Power and energy history of every plug, one memory-mapped append-only
+ * file per plug. Timestamps are stored as deltas, with an absolute time
+ * every checkpoint interval records so a window is found by binary search.
+ * Appends only dirty the page mapped under them. The header count of
+ * committed records is flushed every syncEvery appends, after the records
+ * it covers, and records past it are validated when the file is opened
+ * again, so a crash loses at most the unflushed tail.
+ */
+class MuzzleyEnergyStore {
+  public:
+
+    /**
+     * Constructor
+     * @param directory - where the plug files are kept
+     * @param syncEvery - appends between flushes of a plug file
+     */
+    MuzzleyEnergyStore(const std::string& directory, unsigned int syncEvery);
+
+    /**
+     * Destructor, flushes and unmaps every file
+     */
+    ~MuzzleyEnergyStore();
+
+    /**
+     * Append a reading of a plug, readings not newer than the last one are ignored
+     * @return true if it was stored
+     */
+    bool Append(const std::string& plugID, time_t when, float power, float energy);
+
+    /**
+     * Readings of a plug within [from, to], oldest first
+     */
+    std::vector<MuzzleyEnergySample> Query(const std::string& plugID, time_t from, time_t to);
+
+    /**
+     * Most recent reading of a plug
+     * @return true if sample was filled
+     */
+    bool Last(const std::string& plugID, MuzzleyEnergySample& sample);
+
+    /**
+     * Set where the plug files are kept, files already open stay where they are
+     */
+    void SetDirectory(const std::string& directory);
+
+    /**
+     * Flush every file
+     */
+    void Sync();
+
+    /**
+     * Flush and unmap every file
+     */
+    void Close();
+
+  private:
+
+    struct Header {
+        char magic[4];
+        uint16_t version;
+        uint16_t recordSize;
+        uint32_t committed;
+        uint32_t reserved;
+    };
+
+    struct Log {
+        int fd;
+        char* map;
+        size_t mapped;
+        size_t count;
+        size_t flushed;
+        time_t last;
+        unsigned int dirty;
+
+        Header* GetHeader() const { return (Header*)map; }
+        MuzzleyEnergyRecord* GetRecords() const { return (MuzzleyEnergyRecord*)(map + sizeof(Header)); }
+        size_t GetCapacity() const { return (mapped - sizeof(Header)) / sizeof(MuzzleyEnergyRecord); }
+    };
+
+    static uint16_t Check(size_t index, const MuzzleyEnergyRecord& record);
+
+    static time_t TimeAt(const Log& log, size_t index);
+
+    Log* Open(const std::string& plugID, bool create);
+
+    bool Map(Log& log, size_t size);
+
+    void Recover(Log& log);
+
+    void Flush(Log& log);
+
+    void Unmap(Log& log);
+
+    std::string directory;
+
+    unsigned int syncEvery;
+
+    std::unordered_map<std::string, std::unique_ptr<Log> > logs;
+
+    std::mutex lock;
+};
+
+#endif /* MUZZLEYENERGYSTORE_H_ */
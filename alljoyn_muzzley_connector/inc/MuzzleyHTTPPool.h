@@ -0,0 +1,103 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef MUZZLEYHTTPPOOL_H_
+#define MUZZLEYHTTPPOOL_H_
+
+#include <condition_variable>
+#include <ctime>
+#include <list>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <mutex>
+#include <string>
+#include <muzzley/muzzley.h>
+#include <muzzley/parsers/http.h>
+
+/**
+ * Keep-alive HTTP/1.1 connections, pooled per host and port.
+ * A request takes an idle connection, or opens one while the host is under
+ * its connection cap, and gives it back once the reply is read. A reused
+ * connection the server already closed is detected on the exchange and an
+ * idempotent request (GET, PUT, DELETE) is sent again on a new one; a POST
+ * may have been applied already and fails instead. Idle connections are
+ * closed by Evict.
+ */
+class MuzzleyHTTPPool {
+  public:
+
+    /**
+     * Constructor
+     * @param maxPerHost - most connections open to one host and port
+     * @param idleTimeout - seconds an idle connection is kept open
+     */
+    MuzzleyHTTPPool(unsigned int maxPerHost, unsigned int idleTimeout);
+
+    /**
+     * Destructor, closes every connection
+     */
+    ~MuzzleyHTTPPool();
+
+    /**
+     * Send a request and read its reply, blocks while the host is at its cap
+     */
+    muzzley::HTTPRep Send(const std::string& host, int port, muzzley::HTTPReq& request);
+
+    /**
+     * Close the connections idle for longer than the idle timeout
+     * @return number of connections closed
+     */
+    size_t Evict();
+
+    /**
+     * Close every idle connection
+     */
+    void Clear();
+
+  private:
+
+    struct Connection {
+        std::unique_ptr<muzzley::socketstream> socket;
+        time_t lastUsed;
+    };
+
+    struct Host {
+        std::list<Connection> idle;
+        unsigned int open;
+    };
+
+    static std::string Key(const std::string& host, int port);
+
+    bool Acquire(const std::string& key, Connection& connection);
+
+    void Release(const std::string& key, Connection& connection, bool keep);
+
+    static bool Exchange(Connection& connection, muzzley::HTTPReq& request, muzzley::HTTPRep& reply);
+
+    unsigned int maxPerHost;
+
+    unsigned int idleTimeout;
+
+    std::map<std::string, Host> hosts;
+
+    std::condition_variable released;
+
+    std::mutex lock;
+};
+
+#endif /* MUZZLEYHTTPPOOL_H_ */
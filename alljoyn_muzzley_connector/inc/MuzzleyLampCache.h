@@ -0,0 +1,91 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef MUZZLEYLAMPCACHE_H_
+#define MUZZLEYLAMPCACHE_H_
+
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <LSFTypes.h>
+
+/**
+ * Last known state of a lamp, as reported by the controller service
+ */
+struct MuzzleyLampShadow {
+    lsf::LampState state;
+    bool hasState;
+    bool reachable;
+    time_t stateUpdated;
+    time_t reachableUpdated;
+};
+
+/**
+ * Shadow copy of the lamp states, kept current from the LampStateChanged
+ * signal and the GetLampState replies. Reads that find a fresh entry are
+ * answered without a controller service round trip.
+ */
+class MuzzleyLampCache {
+  public:
+
+    /**
+     * Constructor
+     * @param ttl - seconds an entry is fresh, 0 disables the cache
+     */
+    MuzzleyLampCache(unsigned int ttl);
+
+    /**
+     * Destructor
+     */
+    ~MuzzleyLampCache();
+
+    /**
+     * Store the state reported for a lamp, which also makes it reachable
+     */
+    void Update(const std::string& lampID, const lsf::LampState& state);
+
+    /**
+     * Mark a lamp as unreachable, keeping its last known state
+     */
+    void SetUnreachable(const std::string& lampID);
+
+    /**
+     * Get the shadow of a lamp if it was updated within the ttl
+     * @return true if shadow was filled
+     */
+    bool GetFresh(const std::string& lampID, MuzzleyLampShadow& shadow) const;
+
+    /**
+     * Forget a lamp
+     */
+    void Remove(const std::string& lampID);
+
+    /**
+     * Set the ttl, in seconds
+     */
+    void SetTTL(unsigned int ttl);
+  private:
+
+    unsigned int ttl;
+
+    std::unordered_map<std::string, MuzzleyLampShadow> shadows;
+
+    mutable std::mutex lock;
+};
+
+#endif /* MUZZLEYLAMPCACHE_H_ */
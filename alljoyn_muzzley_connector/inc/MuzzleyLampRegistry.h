@@ -0,0 +1,138 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef MUZZLEYLAMPREGISTRY_H_
+#define MUZZLEYLAMPREGISTRY_H_
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * A lamp known to the connector
+ */
+struct MuzzleyLamp {
+    std::string id;
+    std::string name;
+};
+
+/**
+ * Lamps that appeared and disappeared between two lamp lists
+ */
+struct MuzzleyLampDelta {
+    std::vector<std::string> added;
+    std::vector<std::string> removed;
+};
+
+/**
+ * Lamps known to the connector, by lamp id.
+ * Readers take an immutable snapshot and never wait for writers. Writers
+ * are serialized, copy the current snapshot, change the copy and publish
+ * it atomically.
+ */
+class MuzzleyLampRegistry {
+  public:
+
+    typedef std::unordered_map<std::string, MuzzleyLamp> Lamps;
+
+    typedef std::shared_ptr<const Lamps> Snapshot;
+
+    /**
+     * Constructor
+     */
+    MuzzleyLampRegistry();
+
+    /**
+     * Destructor
+     */
+    ~MuzzleyLampRegistry();
+
+    /**
+     * The current lamps, unaffected by later changes
+     */
+    Snapshot GetSnapshot() const;
+
+    /**
+     * Check if a lamp is known
+     */
+    bool Has(const std::string& lampID) const;
+
+    /**
+     * Get a lamp
+     * @return true if lamp was filled
+     */
+    bool Get(const std::string& lampID, MuzzleyLamp& lamp) const;
+
+    /**
+     * Name of a lamp, empty if it is not known
+     */
+    std::string GetName(const std::string& lampID) const;
+
+    /**
+     * Add a lamp if it is not known yet, a known lamp keeps its name
+     * @return true if the lamp was added
+     */
+    bool Add(const std::string& lampID, const std::string& name);
+
+    /**
+     * Add a lamp or change the name of a known one
+     * @return true if something changed
+     */
+    bool SetName(const std::string& lampID, const std::string& name);
+
+    /**
+     * Change the name of a known lamp
+     * @return true if the lamp is known
+     */
+    bool Rename(const std::string& lampID, const std::string& name);
+
+    /**
+     * Remove a lamp
+     * @return true if the lamp was known
+     */
+    bool Remove(const std::string& lampID);
+
+    /**
+     * Remove every lamp
+     */
+    void Clear();
+
+    /**
+     * Make the registry hold exactly the lamps in lampIDs. New lamps get
+     * name, known lamps keep theirs. Linear in the size of both lists.
+     * @param delta - filled with the lamps added and removed
+     */
+    void Reconcile(const std::list<std::string>& lampIDs, const std::string& name, MuzzleyLampDelta& delta);
+
+    /**
+     * Number of lamps
+     */
+    size_t Size() const;
+
+  private:
+
+    void Publish(Lamps* lamps);
+
+    Snapshot current;
+
+    std::mutex writeLock;
+};
+
+#endif /* MUZZLEYLAMPREGISTRY_H_ */
@@ -0,0 +1,125 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef MUZZLEYMETERHISTORY_H_
+#define MUZZLEYMETERHISTORY_H_
+
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <MuzzleyPlugRegistry.h>
+
+/**
+ * Samples of a plug value that fell in the same period
+ */
+struct MuzzleyMeterBucket {
+    time_t start;
+    double min;
+    double max;
+    double sum;
+    unsigned int count;
+
+    double Avg() const { return count == 0 ? 0 : sum / count; }
+};
+
+/**
+ * Recent readings of every plug, downsampled to min/max/avg per second,
+ * per minute and per hour. Each tier is a ring of fixed capacity that
+ * overwrites its oldest bucket, so the memory per plug is bounded no
+ * matter how long the connector runs or how often plugs are sampled.
+ */
+class MuzzleyMeterHistory {
+  public:
+
+    enum Tier {
+        TIER_SECOND = 0,
+        TIER_MINUTE,
+        TIER_HOUR,
+        TIER_COUNT
+    };
+
+    /**
+     * Constructor
+     * @param seconds - per second buckets kept for each plug value
+     * @param minutes - per minute buckets kept for each plug value
+     * @param hours - per hour buckets kept for each plug value
+     */
+    MuzzleyMeterHistory(size_t seconds, size_t minutes, size_t hours);
+
+    /**
+     * Destructor
+     */
+    ~MuzzleyMeterHistory();
+
+    /**
+     * Record a reading, readings older than the newest bucket of a tier are dropped from it
+     */
+    void Add(const std::string& plugID, MuzzleyPlugValue value, double sample, time_t when);
+
+    /**
+     * Buckets of a plug value that start within [from, to], oldest first
+     */
+    std::vector<MuzzleyMeterBucket> Query(const std::string& plugID, MuzzleyPlugValue value, Tier tier, time_t from, time_t to) const;
+
+    /**
+     * Most recent bucket of a plug value
+     * @return true if bucket was filled
+     */
+    bool Last(const std::string& plugID, MuzzleyPlugValue value, Tier tier, MuzzleyMeterBucket& bucket) const;
+
+    /**
+     * Drop the history of a plug
+     */
+    void Remove(const std::string& plugID);
+
+    /**
+     * Number of plugs with history
+     */
+    size_t Size() const;
+
+  private:
+
+    struct Ring {
+        std::vector<MuzzleyMeterBucket> buckets;
+        /**
+         * Position of the newest bucket
+         */
+        size_t newest;
+    };
+
+    struct Series {
+        Ring tiers[TIER_COUNT];
+    };
+
+    struct Plug {
+        Series values[PLUG_VALUE_COUNT];
+    };
+
+    static const time_t periods[TIER_COUNT];
+
+    void Record(Ring& ring, size_t capacity, time_t start, double sample);
+
+    size_t capacities[TIER_COUNT];
+
+    std::unordered_map<std::string, Plug> plugs;
+
+    mutable std::mutex lock;
+};
+
+#endif /* MUZZLEYMETERHISTORY_H_ */
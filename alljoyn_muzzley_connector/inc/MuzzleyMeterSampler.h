@@ -0,0 +1,125 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef MUZZLEYMETERSAMPLER_H_
+#define MUZZLEYMETERSAMPLER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Asks the watched plugs for new readings on an adaptive schedule.
+ * A plug is sampled every minimum interval while its power keeps changing,
+ * and the interval doubles up to the maximum each time a sample shows no
+ * significant change. Samples are requested from a worker thread, so a
+ * slow plug never holds up the caller.
+ */
+class MuzzleyMeterSampler {
+  public:
+
+    /**
+     * Requests a reading from a plug
+     */
+    typedef std::function<void (const std::string& plugID)> Sample;
+
+    /**
+     * Constructor
+     * @param minInterval - milliseconds between samples while the power changes
+     * @param maxInterval - milliseconds between samples of an idle plug
+     * @param threshold - relative power change that counts as significant
+     */
+    MuzzleyMeterSampler(unsigned int minInterval, unsigned int maxInterval, double threshold);
+
+    /**
+     * Destructor, stops the worker thread
+     */
+    ~MuzzleyMeterSampler();
+
+    /**
+     * Start the worker thread, readings are requested through sample
+     */
+    void Start(Sample sample);
+
+    /**
+     * Stop the worker thread
+     */
+    void Stop();
+
+    /**
+     * Sample a plug, starting now at the minimum interval
+     */
+    void Watch(const std::string& plugID);
+
+    /**
+     * Stop sampling a plug
+     */
+    void Unwatch(const std::string& plugID);
+
+    /**
+     * A power reading of a plug arrived, a significant change brings the
+     * plug back to the minimum interval
+     */
+    void Observe(const std::string& plugID, double power);
+
+    /**
+     * Current sampling interval of a plug in milliseconds, 0 if it is not watched
+     */
+    unsigned int GetInterval(const std::string& plugID) const;
+
+  private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Plug {
+        unsigned int interval;
+        Clock::time_point due;
+        bool hasPower;
+        double power;
+        /**
+         * A significant change was seen since the last sample
+         */
+        bool changed;
+    };
+
+    void Run();
+
+    unsigned int minInterval;
+
+    unsigned int maxInterval;
+
+    double threshold;
+
+    Sample sample;
+
+    std::unordered_map<std::string, Plug> plugs;
+
+    bool running;
+
+    std::thread worker;
+
+    mutable std::mutex lock;
+
+    std::condition_variable wakeup;
+};
+
+#endif /* MUZZLEYMETERSAMPLER_H_ */
@@ -0,0 +1,154 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef MUZZLEYNAMERESOLVER_H_
+#define MUZZLEYNAMERESOLVER_H_
+
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "MuzzleyScheduler.h"
+
+/**
+ * Resolves lamp names with a bounded number of queries in flight.
+ * A failed lamp is retried after an exponential backoff; a lamp that keeps
+ * failing goes to a negative cache and is not queried until it expires.
+ * Resolved names are handed over in batches, when no query is left or the
+ * batch is full. Every query has its own timeout timer.
+ */
+class MuzzleyNameResolver {
+  public:
+
+    /**
+     * Issues the name query for a lamp, returns false if it could not be sent
+     */
+    typedef std::function<bool (const std::string& lampID)> Query;
+
+    /**
+     * Receives a batch of lampID/name pairs
+     */
+    typedef std::function<void (const std::vector<std::pair<std::string, std::string> >& names)> Resolved;
+
+    /**
+     * Constructor
+     * @param window - most queries in flight
+     * @param timeout - seconds to wait for the reply of a query
+     * @param backoff - seconds before the first retry, doubled on every failure
+     * @param maxFailures - failures in a row that put a lamp in the negative cache
+     * @param negativeTTL - seconds a lamp stays in the negative cache
+     * @param maxBatch - most names handed over in one batch
+     * @param defer - timer used for retries and query timeouts
+     */
+    MuzzleyNameResolver(unsigned int window, unsigned int timeout, unsigned int backoff, unsigned int maxFailures,
+                        unsigned int negativeTTL, unsigned int maxBatch, MuzzleyScheduler::Defer defer);
+
+    /**
+     * Destructor
+     */
+    ~MuzzleyNameResolver();
+
+    /**
+     * Set how queries are issued and where resolved names go
+     */
+    void SetHandlers(Query query, Resolved resolved);
+
+    /**
+     * Resolve the names of lamps. Lamps already queued, in flight, backing
+     * off or in the negative cache are skipped.
+     */
+    void Resolve(const std::vector<std::string>& lampIDs);
+
+    /**
+     * The reply of a name query arrived
+     */
+    void Reply(const std::string& lampID, bool ok, const std::string& name);
+
+    /**
+     * Stop resolving a lamp
+     */
+    void Forget(const std::string& lampID);
+
+  private:
+
+    enum State {
+        QUEUED,
+        IN_FLIGHT,
+        BACKING_OFF,
+        NEGATIVE
+    };
+
+    struct Lamp {
+        State state;
+        unsigned int failures;
+        time_t since;
+        unsigned int query;
+    };
+
+    typedef std::vector<std::pair<std::string, std::string> > Names;
+
+    /**
+     * lampID and a number: the delay of a retry, or the query of an issue
+     */
+    typedef std::vector<std::pair<std::string, unsigned int> > Lamps;
+
+    void Fail(const std::string& lampID, Lamp& lamp, time_t now, Lamps& retries);
+
+    void Expire(const std::string& lampID, unsigned int sent);
+
+    void Retry(const std::string& lampID);
+
+    void Pump(Lamps& issue, Names& batch);
+
+    void Run(Lamps& issue, Names& batch, Lamps& retries);
+
+    unsigned int window;
+
+    unsigned int timeout;
+
+    unsigned int backoff;
+
+    unsigned int maxFailures;
+
+    unsigned int negativeTTL;
+
+    unsigned int maxBatch;
+
+    MuzzleyScheduler::Defer defer;
+
+    Query query;
+
+    Resolved resolved;
+
+    std::unordered_map<std::string, Lamp> lamps;
+
+    std::deque<std::string> queue;
+
+    unsigned int inFlight;
+
+    unsigned int queries;
+
+    Names names;
+
+    std::mutex lock;
+};
+
+#endif /* MUZZLEYNAMERESOLVER_H_ */
@@ -0,0 +1,100 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef MUZZLEYPENDINGCALLS_H_
+#define MUZZLEYPENDINGCALLS_H_
+
+#include <ctime>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Controller service calls in flight, keyed by method name and lamp ID.
+ * Callers that want the same reply join the outstanding call instead of
+ * issuing a new one, and may leave a continuation to run when it completes.
+ * A call that got no reply within the in-flight window is considered lost
+ * and the next caller issues it again; earlier continuations keep waiting.
+ */
+class MuzzleyPendingCalls {
+  public:
+
+    /**
+     * Runs when the call completes, ok is false if it failed
+     */
+    typedef std::function<void (bool ok)> Continuation;
+
+    /**
+     * Constructor
+     * @param window - seconds a call stays in flight without a reply
+     */
+    MuzzleyPendingCalls(unsigned int window);
+
+    /**
+     * Destructor
+     */
+    ~MuzzleyPendingCalls();
+
+    /**
+     * Join the call for (method, id)
+     * @return true if there was no call in flight and the caller must issue it
+     */
+    bool Join(const std::string& method, const std::string& id);
+
+    /**
+     * Join the call for (method, id) and run then when it completes
+     * @return true if there was no call in flight and the caller must issue it
+     */
+    bool Join(const std::string& method, const std::string& id, Continuation then);
+
+    /**
+     * The call for (method, id) got its reply, or failed to be sent.
+     * Continuations run on the calling thread, after the call is removed.
+     * @return number of callers that were waiting for it
+     */
+    unsigned int Complete(const std::string& method, const std::string& id, bool ok = true);
+
+    /**
+     * Check if the call for (method, id) is in flight
+     */
+    bool InFlight(const std::string& method, const std::string& id) const;
+
+    /**
+     * Number of calls in flight
+     */
+    size_t Size() const;
+
+  private:
+
+    struct Call {
+        time_t issued;
+        unsigned int waiters;
+        std::vector<Continuation> continuations;
+    };
+
+    static std::string Key(const std::string& method, const std::string& id);
+
+    unsigned int window;
+
+    std::unordered_map<std::string, Call> calls;
+
+    mutable std::mutex lock;
+};
+
+#endif /* MUZZLEYPENDINGCALLS_H_ */
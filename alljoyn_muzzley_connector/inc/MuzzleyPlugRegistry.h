@@ -0,0 +1,177 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef MUZZLEYPLUGREGISTRY_H_
+#define MUZZLEYPLUGREGISTRY_H_
+
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <alljoyn/controlpanel/Action.h>
+#include <alljoyn/controlpanel/Property.h>
+
+/**
+ * Values a plug reports through its control panel
+ */
+enum MuzzleyPlugValue {
+    PLUG_STATUS = 0,
+    PLUG_VOLTAGE,
+    PLUG_CURRENT,
+    PLUG_FREQUENCY,
+    PLUG_POWER,
+    PLUG_ENERGY,
+    PLUG_VALUE_COUNT
+};
+
+/**
+ * Actions a plug offers through its control panel
+ */
+enum MuzzleyPlugAction {
+    PLUG_GET_PROPERTIES = 0,
+    PLUG_ON,
+    PLUG_OFF,
+    PLUG_ACTION_COUNT
+};
+
+/**
+ * A plug known to the connector, with the control panel widgets found when
+ * it was announced and the last value read from each property
+ */
+struct MuzzleyPlug {
+    std::string id;
+    std::string name;
+    /**
+     * Interned id, stays the same for the life of the process
+     */
+    unsigned int index;
+    time_t added;
+    ajn::services::Property* properties[PLUG_VALUE_COUNT];
+    ajn::services::Action* actions[PLUG_ACTION_COUNT];
+    std::string values[PLUG_VALUE_COUNT];
+    /**
+     * When each value last changed, 0 if it was never read
+     */
+    time_t updated[PLUG_VALUE_COUNT];
+};
+
+/**
+ * Plugs known to the connector, by device id. Lookups are a single hash
+ * probe, and the plugs are listed in the order they were first announced.
+ */
+class MuzzleyPlugRegistry {
+  public:
+
+    /**
+     * Constructor
+     */
+    MuzzleyPlugRegistry();
+
+    /**
+     * Destructor
+     */
+    ~MuzzleyPlugRegistry();
+
+    /**
+     * Add a plug or replace the widgets of a known one, cached values are dropped
+     * @return the stored plug
+     */
+    MuzzleyPlug Add(const std::string& plugID, const std::string& name,
+                    ajn::services::Property* const properties[PLUG_VALUE_COUNT],
+                    ajn::services::Action* const actions[PLUG_ACTION_COUNT]);
+
+    /**
+     * Remove a plug
+     * @return true if the plug was known
+     */
+    bool Remove(const std::string& plugID);
+
+    /**
+     * Check if a plug is known
+     */
+    bool Has(const std::string& plugID) const;
+
+    /**
+     * Get a plug
+     * @return true if plug was filled
+     */
+    bool Get(const std::string& plugID, MuzzleyPlug& plug) const;
+
+    /**
+     * Widget of a plug property, NULL if the plug or the widget is not known
+     */
+    ajn::services::Property* GetProperty(const std::string& plugID, MuzzleyPlugValue value) const;
+
+    /**
+     * Widget of a plug action, NULL if the plug or the widget is not known
+     */
+    ajn::services::Action* GetAction(const std::string& plugID, MuzzleyPlugAction action) const;
+
+    /**
+     * Plug and value a property widget belongs to
+     * @return true if the widget belongs to a known plug
+     */
+    bool FindProperty(const ajn::services::Property* property, std::string& plugID, MuzzleyPlugValue& value) const;
+
+    /**
+     * Store the last value read from a plug property
+     * @return true if the plug is known and the value changed
+     */
+    bool SetValue(const std::string& plugID, MuzzleyPlugValue value, const std::string& data);
+
+    /**
+     * Last value read from a plug property
+     * @return true if the plug is known and the value was read at least once
+     */
+    bool GetValue(const std::string& plugID, MuzzleyPlugValue value, std::string& data) const;
+
+    /**
+     * Every plug, in the order they were first announced
+     */
+    std::vector<MuzzleyPlug> List() const;
+
+    /**
+     * Number of plugs
+     */
+    size_t Size() const;
+
+  private:
+
+    MuzzleyPlug* Find(const std::string& plugID) const;
+
+    void Unwatch(const MuzzleyPlug& plug);
+
+    std::unordered_map<std::string, unsigned int> interned;
+
+    /**
+     * Indexed by interned id, empty slots are plugs that went away
+     */
+    std::vector<std::unique_ptr<MuzzleyPlug> > plugs;
+
+    /**
+     * Property widget to interned id and value, for change signals
+     */
+    std::unordered_map<const ajn::services::Property*, std::pair<unsigned int, MuzzleyPlugValue> > watched;
+
+    size_t count;
+
+    mutable std::mutex lock;
+};
+
+#endif /* MUZZLEYPLUGREGISTRY_H_ */
@@ -0,0 +1,167 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef MUZZLEYPUBLISHER_H_
+#define MUZZLEYPUBLISHER_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <muzzley/muzzley.h>
+
+/**
+ * Single writer for a muzzley::Client.
+ * Any thread may queue replies and publishes; one sender thread drains the
+ * queue and is the only one writing to the client. Replies and publishes
+ * are queued in two bounded ring buffers, producers only take a lock to wake
+ * the sender when it is asleep. When a ring is full its oldest frame is
+ * dropped to make room, so a burst of publishes never costs a read its
+ * reply. Replies are sent first.
+ * With a batch window set, the property publishes of a channel queued within
+ * the window are sent as one frame on the "*" component and property. Replies
+ * are never batched.
+ */
+class MuzzleyPublisher {
+  public:
+
+    /**
+     * Constructor
+     * @param capacity - slots of each ring buffer, rounded up to a power of two
+     */
+    MuzzleyPublisher(size_t capacity = 1024);
+
+    /**
+     * Destructor, stops the sender thread
+     */
+    ~MuzzleyPublisher();
+
+    /**
+     * Start the sender thread for client
+     */
+    void Start(muzzley::Client* client);
+
+    /**
+     * Send what is queued and stop the sender thread
+     */
+    void Stop();
+
+    /**
+     * Queue a reply to a read request
+     */
+    void Reply(const muzzley::Message& message);
+
+    /**
+     * Queue a property publish
+     * @param subscription - channel, component and property it is published on
+     * @param message - the message sent when it is not batched
+     * @param channel - batches are per channel
+     * @param component - component id, for the batch frame
+     * @param property - property name, for the batch frame
+     * @param data - property data, for the batch frame
+     */
+    void Publish(const muzzley::Subscription& subscription, const muzzley::Message& message,
+                 const std::string& channel, const std::string& component, const std::string& property, const muzzley::JSONObj& data);
+
+    /**
+     * Set how long publishes wait for others to share a frame, 0 disables batching
+     */
+    void SetBatchWindow(unsigned int milliseconds);
+
+    /**
+     * Frames dropped because the queue was full
+     */
+    size_t GetDropped() const;
+
+  private:
+
+    struct Outgoing {
+        bool reply;
+        muzzley::Subscription subscription;
+        muzzley::Message message;
+        std::string channel;
+        std::string component;
+        std::string property;
+        muzzley::JSONObj data;
+    };
+
+    /**
+     * Publishes waiting for the batch window, by channel and then by
+     * component/property, so a newer value replaces an older one
+     */
+    typedef std::map<std::string, std::map<std::pair<std::string, std::string>, Outgoing> > Batches;
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        Outgoing outgoing;
+    };
+
+    struct Ring {
+        std::vector<Cell> cells;
+        size_t mask;
+        std::atomic<size_t> head;
+        std::atomic<size_t> tail;
+    };
+
+    static void Init(Ring& ring, size_t capacity);
+
+    void Push(Ring& ring, Outgoing& outgoing);
+
+    static bool Pop(Ring& ring, Outgoing& outgoing);
+
+    bool Pop(Outgoing& outgoing);
+
+    void Send(Outgoing& outgoing);
+
+    void Batch(Outgoing& outgoing);
+
+    void Flush();
+
+    void Run();
+
+    Ring replies;
+
+    Ring publishes;
+
+    std::atomic<size_t> dropped;
+
+    muzzley::Client* client;
+
+    std::thread sender;
+
+    std::atomic<bool> running;
+
+    std::atomic<bool> sleeping;
+
+    std::atomic<unsigned int> batchWindow;
+
+    Batches batches;
+
+    std::chrono::steady_clock::time_point batchDeadline;
+
+    std::mutex lock;
+
+    std::condition_variable wakeup;
+};
+
+#endif /* MUZZLEYPUBLISHER_H_ */
@@ -0,0 +1,135 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef MUZZLEYREQUESTTABLE_H_
+#define MUZZLEYREQUESTTABLE_H_
+
+#include <stdint.h>
+#include <ctime>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Muzzley read request waiting for a property value
+ */
+struct MuzzleyRequest {
+    std::string component;
+    std::string property;
+    std::string cid;
+    int t;
+    time_t time;
+    std::string type;
+};
+
+/**
+ * Table of pending Muzzley read requests.
+ * Requests are indexed by (component, property), so a published value finds
+ * all of its waiters with one hash lookup. Expiry is driven by a hashed timer
+ * wheel with one slot per second, so only the requests due in the elapsed
+ * ticks are visited.
+ */
+class MuzzleyRequestTable {
+  public:
+
+    /**
+     * Constructor
+     * @param timeout - seconds a request may stay pending
+     * @param wheelSize - number of one second slots in the timer wheel
+     */
+    MuzzleyRequestTable(unsigned int timeout, unsigned int wheelSize = 64);
+
+    /**
+     * Destructor
+     */
+    ~MuzzleyRequestTable();
+
+    /**
+     * Add a pending request
+     * @return boolean
+     */
+    bool Add(const std::string& component, const std::string& property, const std::string& cid, int t, const std::string& type);
+
+    /**
+     * Remove and return every request waiting for (component, property),
+     * in arrival order
+     * @return number of requests taken
+     */
+    size_t Take(const std::string& component, const std::string& property, std::vector<MuzzleyRequest>& requests);
+
+    /**
+     * Check if there are requests waiting for (component, property)
+     */
+    bool Has(const std::string& component, const std::string& property) const;
+
+    /**
+     * Remove and return the requests whose deadline is not after now
+     * @return number of requests expired
+     */
+    size_t Expire(time_t now, std::vector<MuzzleyRequest>& expired);
+
+    /**
+     * Remove and return every request for a component
+     * @return number of requests removed
+     */
+    size_t RemoveComponent(const std::string& component, std::vector<MuzzleyRequest>& removed);
+
+    /**
+     * List the components with pending requests
+     */
+    void GetComponents(std::vector<std::string>& components) const;
+
+    /**
+     * Copy every pending request, for printing
+     */
+    void GetRequests(std::vector<MuzzleyRequest>& requests) const;
+
+    /**
+     * Number of pending requests
+     */
+    size_t Size() const;
+
+  private:
+
+    typedef uint64_t RequestId;
+
+    struct Entry {
+        MuzzleyRequest request;
+        time_t deadline;
+    };
+
+    typedef std::deque<RequestId> Waiters;
+    typedef std::unordered_map<std::string, Waiters> PropertyIndex;
+    typedef std::unordered_map<std::string, PropertyIndex> ComponentIndex;
+
+    void Unlink(RequestId id, const MuzzleyRequest& request);
+
+    unsigned int timeout;
+    unsigned int wheelSize;
+    RequestId nextId;
+    time_t currentTick;
+
+    std::unordered_map<RequestId, Entry> entries;
+    ComponentIndex index;
+    std::vector<std::vector<RequestId> > wheel;
+
+    mutable std::mutex lock;
+};
+
+#endif /* MUZZLEYREQUESTTABLE_H_ */
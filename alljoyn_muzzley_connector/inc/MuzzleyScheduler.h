@@ -0,0 +1,120 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef MUZZLEYSCHEDULER_H_
+#define MUZZLEYSCHEDULER_H_
+
+#include <glib.h>
+#include <functional>
+
+/**
+ * Event loop that owns the connector periodic work.
+ * Timers are GLib timeout sources on a private GMainContext, so the loop
+ * sleeps in poll() until the next deadline instead of spinning. The context
+ * is thread-default while Run() executes, so sources created from tasks,
+ * like the UPnP sockets and SSDP timers, are dispatched by the same loop.
+ * Every method except Run() may be called from any thread.
+ */
+class MuzzleyScheduler {
+  public:
+
+    /**
+     * Periodic task, return false to stop rescheduling it
+     */
+    typedef std::function<bool ()> Task;
+
+    /**
+     * One-shot timer handed to the classes that only need to run work
+     * later, task runs after delay milliseconds on another call stack
+     */
+    typedef std::function<void (unsigned int delay, std::function<void ()> task)> Defer;
+
+    /**
+     * Constructor
+     */
+    MuzzleyScheduler();
+
+    /**
+     * Destructor
+     */
+    ~MuzzleyScheduler();
+
+    /**
+     * Run task every interval milliseconds
+     * @return GLib source id
+     */
+    guint Every(guint interval, Task task);
+
+    /**
+     * Run task every interval seconds. Wakeups are grouped on second
+     * boundaries, which is cheaper for coarse periodic work.
+     * @return GLib source id
+     */
+    guint EverySeconds(guint interval, Task task);
+
+    /**
+     * Run task once after delay milliseconds
+     * @return GLib source id
+     */
+    guint After(guint delay, std::function<void ()> task);
+
+    /**
+     * Run task once, as soon as the loop is idle
+     * @return GLib source id
+     */
+    guint Post(std::function<void ()> task);
+
+    /**
+     * A Defer that runs its tasks with After
+     */
+    Defer GetDefer();
+
+    /**
+     * Run task on the loop when the process receives signum
+     * @return GLib source id
+     */
+    guint OnSignal(int signum, std::function<void ()> task);
+
+    /**
+     * Run the loop on the calling thread until Stop is called
+     */
+    void Run();
+
+    /**
+     * Make Run return
+     */
+    void Stop();
+
+    /**
+     * The context the scheduler sources are attached to
+     */
+    GMainContext* GetContext();
+
+  private:
+
+    guint Attach(GSource* source, Task* task);
+
+    static gboolean Dispatch(gpointer data);
+
+    static void Destroy(gpointer data);
+
+    GMainContext* context;
+
+    GMainLoop* loop;
+};
+
+#endif /* MUZZLEYSCHEDULER_H_ */
@@ -0,0 +1,106 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef MUZZLEYWIDGETLAYOUTS_H_
+#define MUZZLEYWIDGETLAYOUTS_H_
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <alljoyn/controlpanel/Container.h>
+
+/**
+ * Where the widgets a device model exposes sit in its control panel.
+ * The first device of a model is walked and matched by label, the layout
+ * found is kept by manufacturer, model number and panel version, and the
+ * next devices of that model bind their widgets by position in one pass,
+ * checking each widget type and label.
+ */
+class MuzzleyWidgetLayouts {
+  public:
+
+    /**
+     * Child indexes from the root container down to a widget
+     */
+    typedef std::vector<unsigned int> Path;
+
+    /**
+     * A widget the caller looks for, an empty path if the model does not have it
+     */
+    struct Slot {
+        Path path;
+        ajn::services::WidgetType type;
+        std::string label;
+    };
+
+    /**
+     * Slots in the order the caller numbers them
+     */
+    typedef std::vector<Slot> Layout;
+
+    /**
+     * Constructor
+     */
+    MuzzleyWidgetLayouts();
+
+    /**
+     * Destructor
+     */
+    ~MuzzleyWidgetLayouts();
+
+    /**
+     * Key of a device model
+     */
+    static std::string Key(const std::string& manufacturer, const std::string& model, unsigned int version);
+
+    /**
+     * Get the layout of a model
+     * @return true if layout was filled
+     */
+    bool Get(const std::string& key, Layout& layout) const;
+
+    /**
+     * Keep the layout of a model
+     */
+    void Set(const std::string& key, const Layout& layout);
+
+    /**
+     * Forget the layout of a model, the next device of that model is walked again
+     */
+    void Remove(const std::string& key);
+
+    /**
+     * Widget at path, NULL if the panel has nothing there
+     */
+    static ajn::services::Widget* Find(ajn::services::Container* root, const Path& path);
+
+    /**
+     * Find every slot of layout in a panel
+     * @param widgets - filled with a widget per slot, NULL for empty paths
+     * @return false if a widget is missing, of another type or labeled otherwise, the panel does not match the layout
+     */
+    static bool Bind(ajn::services::Container* root, const Layout& layout, std::vector<ajn::services::Widget*>& widgets);
+
+  private:
+
+    std::unordered_map<std::string, Layout> layouts;
+
+    mutable std::mutex lock;
+};
+
+#endif /* MUZZLEYWIDGETLAYOUTS_H_ */
@@ -0,0 +1,121 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef MUZZLEYWRITECOALESCER_H_
+#define MUZZLEYWRITECOALESCER_H_
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "MuzzleyScheduler.h"
+
+/**
+ * Per lamp queue of writes to the controller service.
+ * A lamp has at most one transition in flight and transitions are issued
+ * at least one window apart. While a lamp is busy only the newest write of
+ * each kind is kept, older ones are dropped. A write whose reply does not
+ * come within the reply timeout, or that could not be sent, is considered
+ * done. Any reply for a lamp frees its slot, the window still spaces the
+ * writes when a late reply frees it early.
+ */
+class MuzzleyWriteCoalescer {
+  public:
+
+    /**
+     * Issues the write, returns false if it could not be sent
+     */
+    typedef std::function<bool ()> Write;
+
+    /**
+     * Constructor
+     * @param window - milliseconds between two writes to a lamp
+     * @param timeout - milliseconds to wait for the reply of a write
+     * @param defer - timer used to issue delayed writes and expire lost replies
+     */
+    MuzzleyWriteCoalescer(unsigned int window, unsigned int timeout, MuzzleyScheduler::Defer defer);
+
+    /**
+     * Destructor
+     */
+    ~MuzzleyWriteCoalescer();
+
+    /**
+     * Queue a write of kind for a lamp, replacing a queued write of the same kind
+     */
+    void Submit(const std::string& lampID, int kind, Write write);
+
+    /**
+     * A reply to a write for a lamp arrived
+     */
+    void Completed(const std::string& lampID);
+
+    /**
+     * Drop the queued writes of a lamp
+     */
+    void Forget(const std::string& lampID);
+
+    /**
+     * Set the milliseconds between two writes to a lamp
+     */
+    void SetWindow(unsigned int window);
+
+  private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Lamp {
+        bool inFlight;
+        bool flushScheduled;
+        unsigned long generation;
+        Clock::time_point nextIssue;
+        std::vector<std::pair<int, Write> > pending;
+    };
+
+    /**
+     * What is left to do once the lock is released
+     */
+    struct Actions {
+        Write write;
+        unsigned long generation;
+        bool flush;
+        unsigned int flushDelay;
+    };
+
+    void Issue(Lamp& lamp, Actions& actions);
+
+    void Run(const std::string& lampID, Actions& actions);
+
+    void Flush(const std::string& lampID);
+
+    void Expire(const std::string& lampID, unsigned long generation);
+
+    unsigned int window;
+
+    unsigned int timeout;
+
+    MuzzleyScheduler::Defer defer;
+
+    std::unordered_map<std::string, Lamp> lamps;
+
+    std::mutex lock;
+};
+
+#endif /* MUZZLEYWRITECOALESCER_H_ */
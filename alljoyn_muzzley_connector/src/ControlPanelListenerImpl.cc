@@ -16,6 +16,7 @@
 
 #include "ControlPanelListenerImpl.h"
 #include <alljoyn/controlpanel/ControlPanel.h>
+#include <alljoyn/controlpanel/Property.h>
 #include <iostream>
 #include <algorithm>
 
@@ -30,6 +31,11 @@ ControlPanelListenerImpl::~ControlPanelListenerImpl()
 {
 }
 
+void ControlPanelListenerImpl::setPropertyChangedHandler(PropertyChanged handler)
+{
+    m_PropertyChanged = handler;
+}
+
 void ControlPanelListenerImpl::sessionEstablished(ControlPanelDevice* device)
 {
     if (find(m_ConnectedDevices.begin(), m_ConnectedDevices.end(), device->getDeviceBusName()) != m_ConnectedDevices.end()) {
@@ -92,11 +98,17 @@ void ControlPanelListenerImpl::errorOccured(ControlPanelDevice* device, QStatus
 void ControlPanelListenerImpl::signalPropertiesChanged(ControlPanelDevice* device, Widget* widget)
 {
     std::cout << "Received PropertiesChanged Signal for Widget " << widget->getWidgetName().c_str() << std::endl;
+    if (m_PropertyChanged && widget->getWidgetType() == WIDGET_TYPE_PROPERTY) {
+        m_PropertyChanged(device, (Property*)widget);
+    }
 }
 
 void ControlPanelListenerImpl::signalPropertyValueChanged(ControlPanelDevice* device, Property* property)
 {
     std::cout << "Received ValueChanged Signal for Widget " << property->getWidgetName().c_str() << std::endl;
+    if (m_PropertyChanged) {
+        m_PropertyChanged(device, property);
+    }
 }
 
 void ControlPanelListenerImpl::signalDismiss(ControlPanelDevice* device, NotificationAction* notificationAction)
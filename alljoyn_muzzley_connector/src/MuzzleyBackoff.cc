@@ -0,0 +1,43 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include "MuzzleyBackoff.h"
+
+MuzzleyBackoff::MuzzleyBackoff(unsigned int initial, unsigned int maximum) :
+    initial(initial ? initial : 1),
+    maximum(maximum > initial ? maximum : initial),
+    step(this->initial),
+    random(std::random_device()())
+{
+}
+
+MuzzleyBackoff::~MuzzleyBackoff()
+{
+}
+
+unsigned int MuzzleyBackoff::Next()
+{
+    std::uniform_int_distribution<unsigned int> jitter(step / 2, step);
+    unsigned int delay = jitter(random);
+    step = step > maximum / 2 ? maximum : step * 2;
+    return delay;
+}
+
+void MuzzleyBackoff::Reset()
+{
+    step = initial;
+}
@@ -0,0 +1,137 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include "MuzzleyChangeDetector.h"
+#include <cmath>
+
+MuzzleyChangeDetector::MuzzleyChangeDetector(unsigned int quiet, MuzzleyScheduler::Defer defer) :
+    quiet(quiet),
+    defer(defer)
+{
+}
+
+MuzzleyChangeDetector::~MuzzleyChangeDetector()
+{
+}
+
+void MuzzleyChangeDetector::SetThreshold(const std::string& property, double threshold)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    thresholds[property] = threshold;
+}
+
+void MuzzleyChangeDetector::SetHandler(Settled settled)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    this->settled = settled;
+}
+
+bool MuzzleyChangeDetector::Changed(const std::string& component, const std::string& property, const double* fields, unsigned int count)
+{
+    if (count > MAX_FIELDS) {
+        count = MAX_FIELDS;
+    }
+
+    std::unique_lock<std::mutex> guard(lock);
+
+    double threshold = 0;
+    std::unordered_map<std::string, double>::const_iterator tit = thresholds.find(property);
+    if (tit != thresholds.end()) {
+        threshold = tit->second;
+    }
+
+    PropertyValues& values = published[component];
+    PropertyValues::iterator it = values.find(property);
+    if (it != values.end() && it->second.count == count) {
+        bool changed = false;
+        bool moved = false;
+        for (unsigned int i = 0; i < count && !changed; i++) {
+            double delta = std::fabs(fields[i] - it->second.fields[i]);
+            changed = delta > 0 && delta >= threshold;
+            moved = moved || delta > 0;
+        }
+        if (!changed) {
+            Value& value = it->second;
+            value.holding = moved && defer;
+            if (!value.holding) {
+                return false;
+            }
+            for (unsigned int i = 0; i < count; i++) {
+                value.held[i] = fields[i];
+            }
+            unsigned int change = ++value.change;
+            guard.unlock();
+
+            std::string component_id = component;
+            std::string property_name = property;
+            defer(quiet, [this, component_id, property_name, change] () {
+                Settle(component_id, property_name, change);
+            });
+            return false;
+        }
+    }
+
+    Value& value = values[property];
+    for (unsigned int i = 0; i < count; i++) {
+        value.fields[i] = fields[i];
+    }
+    value.count = count;
+    value.holding = false;
+    return true;
+}
+
+bool MuzzleyChangeDetector::Changed(const std::string& component, const std::string& property, double value)
+{
+    return Changed(component, property, &value, 1);
+}
+
+void MuzzleyChangeDetector::Settle(const std::string& component, const std::string& property, unsigned int change)
+{
+    double fields[MAX_FIELDS];
+    unsigned int count;
+    Settled handler;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        // a newer value restarted the quiet period, or was published
+        std::unordered_map<std::string, PropertyValues>::iterator cit = published.find(component);
+        if (cit == published.end()) {
+            return;
+        }
+        PropertyValues::iterator it = cit->second.find(property);
+        if (it == cit->second.end() || !it->second.holding || it->second.change != change) {
+            return;
+        }
+        Value& value = it->second;
+        value.holding = false;
+        count = value.count;
+        for (unsigned int i = 0; i < count; i++) {
+            value.fields[i] = value.held[i];
+            fields[i] = value.held[i];
+        }
+        handler = settled;
+    }
+    if (handler) {
+        handler(component, property, fields, count);
+    }
+}
+
+void MuzzleyChangeDetector::Forget(const std::string& component)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    published.erase(component);
+}
@@ -0,0 +1,132 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include "MuzzleyComponentLedger.h"
+#include <cstdio>
+#include <fstream>
+#include "sha256.h"
+
+MuzzleyComponentLedger::MuzzleyComponentLedger()
+{
+    fingerprint = Fingerprint(acknowledged);
+}
+
+MuzzleyComponentLedger::~MuzzleyComponentLedger()
+{
+}
+
+void MuzzleyComponentLedger::Load(const std::string& filename, const std::string& deviceKey)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    this->filename = filename;
+    this->deviceKey = deviceKey;
+    acknowledged.clear();
+
+    // deviceKey, fingerprint, then one id<TAB>label line per component
+    std::ifstream file(filename.c_str());
+    std::string key, saved, line;
+    if (getline(file, key) && key == deviceKey && getline(file, saved)) {
+        while (getline(file, line)) {
+            size_t tab = line.find('\t');
+            if (tab != std::string::npos) {
+                acknowledged[line.substr(0, tab)] = line.substr(tab + 1);
+            }
+        }
+    }
+    fingerprint = Fingerprint(acknowledged);
+
+    // a truncated file does not match its own fingerprint, start over
+    if (fingerprint != saved && !acknowledged.empty()) {
+        acknowledged.clear();
+        fingerprint = Fingerprint(acknowledged);
+    }
+}
+
+bool MuzzleyComponentLedger::Filter(std::vector<MuzzleyComponent>& upserts, std::vector<MuzzleyComponent>& removes) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    std::vector<MuzzleyComponent> changed;
+    for (size_t i = 0; i < upserts.size(); i++) {
+        Components::const_iterator it = acknowledged.find(upserts[i].id);
+        if (it == acknowledged.end() || it->second != upserts[i].label) {
+            changed.push_back(upserts[i]);
+        }
+    }
+    upserts.swap(changed);
+
+    changed.clear();
+    for (size_t i = 0; i < removes.size(); i++) {
+        if (acknowledged.count(removes[i].id)) {
+            changed.push_back(removes[i]);
+        }
+    }
+    removes.swap(changed);
+
+    return !upserts.empty() || !removes.empty();
+}
+
+void MuzzleyComponentLedger::Commit(const std::vector<MuzzleyComponent>& upserts, const std::vector<MuzzleyComponent>& removes)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    Apply(acknowledged, upserts, removes);
+    fingerprint = Fingerprint(acknowledged);
+    Save();
+}
+
+std::string MuzzleyComponentLedger::Fingerprint(const Components& components)
+{
+    std::string content;
+    for (Components::const_iterator it = components.begin(); it != components.end(); ++it) {
+        content.append(it->first);
+        content.push_back('\t');
+        content.append(it->second);
+        content.push_back('\n');
+    }
+    return sha256(content);
+}
+
+void MuzzleyComponentLedger::Apply(Components& components, const std::vector<MuzzleyComponent>& upserts, const std::vector<MuzzleyComponent>& removes)
+{
+    for (size_t i = 0; i < removes.size(); i++) {
+        components.erase(removes[i].id);
+    }
+    for (size_t i = 0; i < upserts.size(); i++) {
+        components[upserts[i].id] = upserts[i].label;
+    }
+}
+
+void MuzzleyComponentLedger::Save()
+{
+    if (filename.empty()) {
+        return;
+    }
+
+    // written aside and renamed, a crash never leaves half a ledger behind
+    std::string temporary = filename + ".tmp";
+    std::ofstream file(temporary.c_str(), std::ios::trunc);
+    file << deviceKey << "\n" << fingerprint << "\n";
+    for (Components::const_iterator it = acknowledged.begin(); it != acknowledged.end(); ++it) {
+        file << it->first << "\t" << it->second << "\n";
+    }
+    file.close();
+    if (file.good()) {
+        std::rename(temporary.c_str(), filename.c_str());
+    }
+}
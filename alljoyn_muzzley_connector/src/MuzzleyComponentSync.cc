@@ -0,0 +1,138 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include "MuzzleyComponentSync.h"
+#include <iostream>
+
+MuzzleyComponentSync::MuzzleyComponentSync(unsigned int window, unsigned int retry) :
+    window(window),
+    retry(retry),
+    running(false)
+{
+}
+
+MuzzleyComponentSync::~MuzzleyComponentSync()
+{
+    Stop();
+}
+
+void MuzzleyComponentSync::Start(Send send)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (running) {
+        return;
+    }
+    this->send = send;
+    running = true;
+    worker = std::thread(&MuzzleyComponentSync::Run, this);
+}
+
+void MuzzleyComponentSync::Stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!running) {
+            return;
+        }
+        running = false;
+        wakeup.notify_one();
+    }
+    worker.join();
+}
+
+void MuzzleyComponentSync::Add(const std::string& id, const std::string& label)
+{
+    Queue(id, false, label);
+}
+
+void MuzzleyComponentSync::Remove(const std::string& id, const std::string& label)
+{
+    Queue(id, true, label);
+}
+
+void MuzzleyComponentSync::SetWindow(unsigned int window)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    this->window = window;
+}
+
+void MuzzleyComponentSync::Queue(const std::string& id, bool remove, const std::string& label)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    Change& change = pending[id];
+    change.remove = remove;
+    change.label = label;
+    wakeup.notify_one();
+}
+
+bool MuzzleyComponentSync::Flush(Changes& batch)
+{
+    std::vector<MuzzleyComponent> upserts;
+    std::vector<MuzzleyComponent> removes;
+    for (Changes::iterator it = batch.begin(); it != batch.end(); ++it) {
+        MuzzleyComponent component;
+        component.id = it->first;
+        component.label = it->second.label;
+        if (it->second.remove) {
+            removes.push_back(component);
+        } else {
+            upserts.push_back(component);
+        }
+    }
+
+    try {
+        return send(upserts, removes);
+    } catch (std::exception& e) {
+        std::cout << "Component sync exception: " << e.what() << std::endl << std::flush;
+        return false;
+    }
+}
+
+void MuzzleyComponentSync::Run()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    bool failed = false;
+    for (;;) {
+        while (running && pending.empty()) {
+            wakeup.wait(guard);
+        }
+        if (pending.empty()) {
+            break;
+        }
+
+        // collect what else changes within the window, a failed batch waits longer
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+            std::chrono::milliseconds(failed ? retry : window);
+        wakeup.wait_until(guard, deadline, [this] () { return !running; });
+
+        Changes batch;
+        batch.swap(pending);
+        guard.unlock();
+        bool ok = Flush(batch);
+        guard.lock();
+
+        failed = !ok;
+        if (failed) {
+            // newer changes of the same component win
+            pending.insert(batch.begin(), batch.end());
+            if (!running) {
+                break;
+            }
+        }
+    }
+}
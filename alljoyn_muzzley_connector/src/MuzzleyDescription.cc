@@ -0,0 +1,175 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include "MuzzleyDescription.h"
+#include <cstdio>
+#include <fstream>
+#include <zlib.h>
+#include "sha256.h"
+
+MuzzleyDescription::MuzzleyDescription() :
+    dirty(true)
+{
+}
+
+MuzzleyDescription::~MuzzleyDescription()
+{
+}
+
+bool MuzzleyDescription::SetDevice(const Fields& fields)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (fields == this->fields) {
+        return false;
+    }
+    this->fields = fields;
+    dirty = true;
+    return true;
+}
+
+bool MuzzleyDescription::SetComponents(const std::vector<Component>& components)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    bool same = components.size() == this->components.size();
+    for (size_t i = 0; same && i < components.size(); i++) {
+        same = components[i].id == this->components[i].id &&
+               components[i].label == this->components[i].label &&
+               components[i].type == this->components[i].type;
+    }
+    if (same) {
+        return false;
+    }
+    this->components = components;
+    dirty = true;
+    return true;
+}
+
+bool MuzzleyDescription::Write(const std::string& filename)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    Serialize();
+    if (filename == writtenFile && hash == writtenHash) {
+        return false;
+    }
+
+    // GUPnP serves the file, it must never see it half written
+    std::string temporary = filename + ".tmp";
+    std::ofstream file(temporary.c_str(), std::ios::trunc);
+    file << xml;
+    file.close();
+    if (!file.good() || std::rename(temporary.c_str(), filename.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    writtenFile = filename;
+    writtenHash = hash;
+    return true;
+}
+
+MuzzleyDescription::Snapshot MuzzleyDescription::GetSnapshot()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    Serialize();
+    return snapshot;
+}
+
+void MuzzleyDescription::Serialize()
+{
+    if (!dirty) {
+        return;
+    }
+
+    std::string out;
+    out.reserve(xml.size() ? xml.size() : 1024);
+    out.append("<?xml version=\"1.0\"?>\n<root>\n<specVersion>\n<major>1</major>\n<minor>0</minor>\n</specVersion>\n<device>\n");
+    for (size_t i = 0; i < fields.size(); i++) {
+        out.append("<").append(fields[i].first).append(">");
+        Escape(out, fields[i].second);
+        out.append("</").append(fields[i].first).append(">\n");
+    }
+    out.append("<components>\n");
+    for (size_t i = 0; i < components.size(); i++) {
+        out.append("<component>\n<id>");
+        Escape(out, components[i].id);
+        out.append("</id>\n<label>");
+        Escape(out, components[i].label);
+        out.append("</label>\n<type>");
+        Escape(out, components[i].type);
+        out.append("</type>\n</component>\n");
+    }
+    out.append("</components>\n</device>\n</root>\n");
+
+    xml.swap(out);
+    hash = sha256(xml);
+    dirty = false;
+
+    // readers hold on to the previous document until they are done with it
+    std::shared_ptr<Document> document(new Document());
+    document->xml = xml;
+    document->gzip = Compress(xml);
+    document->etag = "\"" + hash + "\"";
+    document->lastModified = HTTPDate(std::time(0));
+    snapshot = document;
+}
+
+std::string MuzzleyDescription::Compress(const std::string& data)
+{
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    // 16 + MAX_WBITS writes a gzip header instead of a zlib one
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return std::string();
+    }
+
+    std::string out;
+    out.resize(deflateBound(&stream, data.size()) + 32);
+    stream.next_in = (Bytef*)data.data();
+    stream.avail_in = data.size();
+    stream.next_out = (Bytef*)&out[0];
+    stream.avail_out = out.size();
+    int status = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return status == Z_STREAM_END ? out : std::string();
+}
+
+std::string MuzzleyDescription::HTTPDate(time_t time)
+{
+    struct tm gmt;
+    char buffer[64];
+    gmtime_r(&time, &gmt);
+    strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+    return buffer;
+}
+
+void MuzzleyDescription::Escape(std::string& out, const std::string& value)
+{
+    for (size_t i = 0; i < value.size(); i++) {
+        switch (value[i]) {
+            case '&': out.append("&amp;"); break;
+            case '<': out.append("&lt;"); break;
+            case '>': out.append("&gt;"); break;
+            case '"': out.append("&quot;"); break;
+            default: out.push_back(value[i]); break;
+        }
+    }
+}
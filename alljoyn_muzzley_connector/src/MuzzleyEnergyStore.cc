@@ -0,0 +1,343 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include "MuzzleyEnergyStore.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ENERGY_MAGIC "MZEN"
+#define ENERGY_VERSION 1
+#define ENERGY_CHECKPOINT 256
+#define ENERGY_GROW 4096
+#define ENERGY_FLAG_CHECKPOINT 1
+
+MuzzleyEnergyStore::MuzzleyEnergyStore(const std::string& directory, unsigned int syncEvery) :
+    directory(directory),
+    syncEvery(syncEvery == 0 ? 1 : syncEvery)
+{
+}
+
+MuzzleyEnergyStore::~MuzzleyEnergyStore()
+{
+    Close();
+}
+
+void MuzzleyEnergyStore::SetDirectory(const std::string& directory)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    this->directory = directory;
+}
+
+uint16_t MuzzleyEnergyStore::Check(size_t index, const MuzzleyEnergyRecord& record)
+{
+    // FNV-1a over the position and everything but the check itself
+    unsigned char data[sizeof(uint64_t) + sizeof(record.time) + sizeof(record.flags) + sizeof(record.power) + sizeof(record.energy)];
+    uint64_t position = index;
+    size_t size = 0;
+    memcpy(data + size, &position, sizeof(position)); size += sizeof(position);
+    memcpy(data + size, &record.time, sizeof(record.time)); size += sizeof(record.time);
+    memcpy(data + size, &record.flags, sizeof(record.flags)); size += sizeof(record.flags);
+    memcpy(data + size, &record.power, sizeof(record.power)); size += sizeof(record.power);
+    memcpy(data + size, &record.energy, sizeof(record.energy)); size += sizeof(record.energy);
+
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    uint16_t check = (uint16_t)(hash ^ (hash >> 16));
+    // a zeroed slot never passes
+    return check == 0 ? 1 : check;
+}
+
+time_t MuzzleyEnergyStore::TimeAt(const Log& log, size_t index)
+{
+    const MuzzleyEnergyRecord* records = log.GetRecords();
+    size_t checkpoint = index - index % ENERGY_CHECKPOINT;
+    time_t when = records[checkpoint].time;
+    for (size_t i = checkpoint + 1; i <= index; i++) {
+        when += records[i].time;
+    }
+    return when;
+}
+
+bool MuzzleyEnergyStore::Map(Log& log, size_t size)
+{
+    if (log.map != NULL) {
+        munmap(log.map, log.mapped);
+        log.map = NULL;
+        log.mapped = 0;
+    }
+    if (ftruncate(log.fd, size) != 0) {
+        return false;
+    }
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, log.fd, 0);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    log.map = (char*)map;
+    log.mapped = size;
+    return true;
+}
+
+void MuzzleyEnergyStore::Recover(Log& log)
+{
+    MuzzleyEnergyRecord* records = log.GetRecords();
+    size_t capacity = log.GetCapacity();
+
+    // records past the committed count count if they reached the disk whole
+    size_t count = std::min((size_t)log.GetHeader()->committed, capacity);
+    while (count < capacity) {
+        const MuzzleyEnergyRecord& record = records[count];
+        bool checkpoint = (record.flags & ENERGY_FLAG_CHECKPOINT) != 0;
+        if (record.check != Check(count, record) || checkpoint != (count % ENERGY_CHECKPOINT == 0)) {
+            break;
+        }
+        count++;
+    }
+
+    // a stale record after a torn one would pass the check once its slot is reached again
+    static const MuzzleyEnergyRecord zero = MuzzleyEnergyRecord();
+    for (size_t i = count; i < capacity; i++) {
+        if (memcmp(&records[i], &zero, sizeof(zero)) != 0) {
+            records[i] = zero;
+        }
+    }
+
+    // the header is rewritten on the next flush if it disagrees
+    log.count = count;
+    log.flushed = std::min((size_t)log.GetHeader()->committed, count);
+    log.last = count == 0 ? 0 : TimeAt(log, count - 1);
+    log.dirty = log.GetHeader()->committed == count ? 0 : 1;
+}
+
+MuzzleyEnergyStore::Log* MuzzleyEnergyStore::Open(const std::string& plugID, bool create)
+{
+    std::unordered_map<std::string, std::unique_ptr<Log> >::iterator it = logs.find(plugID);
+    if (it != logs.end()) {
+        return it->second.get();
+    }
+
+    std::string name = plugID;
+    std::replace(name.begin(), name.end(), '/', '_');
+    std::string filename = directory + "/" + name + ".energy";
+
+    int fd = open(filename.c_str(), O_RDWR | (create ? O_CREAT : 0), 0644);
+    if (fd < 0) {
+        if (create) {
+            std::cout << "Energy store could not open " << filename << ": " << strerror(errno) << std::endl << std::flush;
+        }
+        return NULL;
+    }
+
+    std::unique_ptr<Log> log(new Log());
+    log->fd = fd;
+    log->map = NULL;
+    log->mapped = 0;
+
+    struct stat info;
+    size_t size = fstat(fd, &info) == 0 ? info.st_size : 0;
+    size_t records = size < sizeof(Header) ? 0 : (size - sizeof(Header)) / sizeof(MuzzleyEnergyRecord);
+    bool valid = false;
+    if (records > 0 && Map(*log, sizeof(Header) + records * sizeof(MuzzleyEnergyRecord))) {
+        Header* header = log->GetHeader();
+        valid = memcmp(header->magic, ENERGY_MAGIC, sizeof(header->magic)) == 0 &&
+                header->version == ENERGY_VERSION && header->recordSize == sizeof(MuzzleyEnergyRecord);
+    }
+
+    if (!valid) {
+        if (size > 0) {
+            std::cout << "Energy store starting over " << filename << ", it is not an energy file" << std::endl << std::flush;
+        }
+        // truncated first, so the new file starts zeroed
+        if (ftruncate(fd, 0) != 0 || !Map(*log, sizeof(Header) + ENERGY_GROW * sizeof(MuzzleyEnergyRecord))) {
+            std::cout << "Energy store could not map " << filename << std::endl << std::flush;
+            Unmap(*log);
+            return NULL;
+        }
+        Header* header = log->GetHeader();
+        memcpy(header->magic, ENERGY_MAGIC, sizeof(header->magic));
+        header->version = ENERGY_VERSION;
+        header->recordSize = sizeof(MuzzleyEnergyRecord);
+        header->committed = 0;
+        header->reserved = 0;
+        msync(log->map, sizeof(Header), MS_SYNC);
+    }
+
+    Recover(*log);
+
+    Log* opened = log.get();
+    logs[plugID] = std::move(log);
+    return opened;
+}
+
+void MuzzleyEnergyStore::Flush(Log& log)
+{
+    if (log.dirty == 0) {
+        return;
+    }
+
+    // the records reach the disk before the header that counts them
+    long page = sysconf(_SC_PAGESIZE);
+    size_t begin = sizeof(Header) + log.flushed * sizeof(MuzzleyEnergyRecord);
+    size_t end = sizeof(Header) + log.count * sizeof(MuzzleyEnergyRecord);
+    begin -= begin % page;
+    if (end > begin) {
+        msync(log.map + begin, end - begin, MS_SYNC);
+    }
+    log.GetHeader()->committed = log.count;
+    msync(log.map, sizeof(Header), MS_SYNC);
+
+    log.flushed = log.count;
+    log.dirty = 0;
+}
+
+void MuzzleyEnergyStore::Unmap(Log& log)
+{
+    if (log.map != NULL) {
+        munmap(log.map, log.mapped);
+        log.map = NULL;
+        log.mapped = 0;
+    }
+    if (log.fd >= 0) {
+        close(log.fd);
+        log.fd = -1;
+    }
+}
+
+bool MuzzleyEnergyStore::Append(const std::string& plugID, time_t when, float power, float energy)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    Log* log = Open(plugID, true);
+    if (log == NULL) {
+        return false;
+    }
+    if (log->count > 0 && when <= log->last) {
+        return false;
+    }
+
+    if (log->count == log->GetCapacity()) {
+        // grown a chunk at a time, the new pages are sparse until written
+        Flush(*log);
+        if (!Map(*log, log->mapped + ENERGY_GROW * sizeof(MuzzleyEnergyRecord))) {
+            std::cout << "Energy store could not grow " << plugID << std::endl << std::flush;
+            Unmap(*log);
+            logs.erase(plugID);
+            return false;
+        }
+    }
+
+    MuzzleyEnergyRecord record;
+    if (log->count % ENERGY_CHECKPOINT == 0) {
+        record.time = (uint32_t)when;
+        record.flags = ENERGY_FLAG_CHECKPOINT;
+    } else {
+        record.time = (uint32_t)(when - log->last);
+        record.flags = 0;
+    }
+    record.power = power;
+    record.energy = energy;
+    record.check = Check(log->count, record);
+    log->GetRecords()[log->count] = record;
+
+    log->count++;
+    log->last = when;
+    log->dirty++;
+    if (log->dirty >= syncEvery) {
+        Flush(*log);
+    }
+    return true;
+}
+
+std::vector<MuzzleyEnergySample> MuzzleyEnergyStore::Query(const std::string& plugID, time_t from, time_t to)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    std::vector<MuzzleyEnergySample> window;
+    Log* log = Open(plugID, false);
+    if (log == NULL || log->count == 0) {
+        return window;
+    }
+    const MuzzleyEnergyRecord* records = log->GetRecords();
+
+    // last checkpoint not after from
+    size_t low = 0;
+    size_t high = (log->count - 1) / ENERGY_CHECKPOINT;
+    while (low < high) {
+        size_t middle = (low + high + 1) / 2;
+        if ((time_t)records[middle * ENERGY_CHECKPOINT].time <= from) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    time_t when = 0;
+    for (size_t i = low * ENERGY_CHECKPOINT; i < log->count; i++) {
+        const MuzzleyEnergyRecord& record = records[i];
+        when = (record.flags & ENERGY_FLAG_CHECKPOINT) ? (time_t)record.time : when + record.time;
+        if (when > to) {
+            break;
+        }
+        if (when >= from) {
+            MuzzleyEnergySample sample = {when, record.power, record.energy};
+            window.push_back(sample);
+        }
+    }
+    return window;
+}
+
+bool MuzzleyEnergyStore::Last(const std::string& plugID, MuzzleyEnergySample& sample)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    Log* log = Open(plugID, false);
+    if (log == NULL || log->count == 0) {
+        return false;
+    }
+    const MuzzleyEnergyRecord& record = log->GetRecords()[log->count - 1];
+    sample.time = log->last;
+    sample.power = record.power;
+    sample.energy = record.energy;
+    return true;
+}
+
+void MuzzleyEnergyStore::Sync()
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    for (std::unordered_map<std::string, std::unique_ptr<Log> >::iterator it = logs.begin(); it != logs.end(); ++it) {
+        Flush(*it->second);
+    }
+}
+
+void MuzzleyEnergyStore::Close()
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    for (std::unordered_map<std::string, std::unique_ptr<Log> >::iterator it = logs.begin(); it != logs.end(); ++it) {
+        Flush(*it->second);
+        Unmap(*it->second);
+    }
+    logs.clear();
+}
@@ -0,0 +1,165 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include "MuzzleyHTTPPool.h"
+#include <iostream>
+#include <sstream>
+
+MuzzleyHTTPPool::MuzzleyHTTPPool(unsigned int maxPerHost, unsigned int idleTimeout) :
+    maxPerHost(maxPerHost ? maxPerHost : 1),
+    idleTimeout(idleTimeout)
+{
+}
+
+MuzzleyHTTPPool::~MuzzleyHTTPPool()
+{
+    Clear();
+}
+
+std::string MuzzleyHTTPPool::Key(const std::string& host, int port)
+{
+    std::ostringstream ss;
+    ss << host << ":" << port;
+    return ss.str();
+}
+
+muzzley::HTTPRep MuzzleyHTTPPool::Send(const std::string& host, int port, muzzley::HTTPReq& request)
+{
+    std::string key = Key(host, port);
+    request->header("Connection", "keep-alive");
+
+    // a reused connection may have been closed by the server, try once more on a new one
+    // unless the server could have applied the request already
+    muzzley::HTTPMethod method = request->method();
+    bool idempotent = method == muzzley::HTTPGet || method == muzzley::HTTPPut || method == muzzley::HTTPDelete;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        Connection connection;
+        bool reused = Acquire(key, connection);
+        if (!reused) {
+            try {
+                connection.socket->open(host, port);
+            } catch (std::exception& e) {
+                Release(key, connection, false);
+                throw;
+            }
+        }
+
+        muzzley::HTTPRep reply;
+        if (Exchange(connection, request, reply)) {
+            std::string close = reply->header("Connection");
+            Release(key, connection, close != "close" && close != "Close");
+            return reply;
+        }
+        Release(key, connection, false);
+        if (!reused || !idempotent) {
+            break;
+        }
+    }
+    throw std::runtime_error("HTTP exchange with " + key + " failed");
+}
+
+size_t MuzzleyHTTPPool::Evict()
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    size_t closed = 0;
+    time_t now = std::time(0);
+    for (std::map<std::string, Host>::iterator it = hosts.begin(); it != hosts.end(); ++it) {
+        std::list<Connection>& idle = it->second.idle;
+        for (std::list<Connection>::iterator c = idle.begin(); c != idle.end(); ) {
+            if (difftime(now, c->lastUsed) >= idleTimeout) {
+                c->socket->close();
+                c = idle.erase(c);
+                it->second.open--;
+                closed++;
+            } else {
+                ++c;
+            }
+        }
+    }
+    if (closed) {
+        released.notify_all();
+    }
+    return closed;
+}
+
+void MuzzleyHTTPPool::Clear()
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    for (std::map<std::string, Host>::iterator it = hosts.begin(); it != hosts.end(); ++it) {
+        std::list<Connection>& idle = it->second.idle;
+        for (std::list<Connection>::iterator c = idle.begin(); c != idle.end(); ++c) {
+            c->socket->close();
+        }
+        it->second.open -= idle.size();
+        idle.clear();
+    }
+    released.notify_all();
+}
+
+bool MuzzleyHTTPPool::Acquire(const std::string& key, Connection& connection)
+{
+    std::unique_lock<std::mutex> guard(lock);
+
+    Host& host = hosts[key];
+    for (;;) {
+        // most recently used first, it is the least likely to be closed by the server
+        if (!host.idle.empty()) {
+            connection.socket = std::move(host.idle.back().socket);
+            host.idle.pop_back();
+            return true;
+        }
+        if (host.open < maxPerHost) {
+            host.open++;
+            connection.socket.reset(new muzzley::socketstream());
+            return false;
+        }
+        released.wait(guard);
+    }
+}
+
+void MuzzleyHTTPPool::Release(const std::string& key, Connection& connection, bool keep)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    Host& host = hosts[key];
+    if (keep) {
+        connection.lastUsed = std::time(0);
+        host.idle.push_back(std::move(connection));
+    } else {
+        connection.socket->close();
+        host.open--;
+    }
+    released.notify_one();
+}
+
+bool MuzzleyHTTPPool::Exchange(Connection& connection, muzzley::HTTPReq& request, muzzley::HTTPRep& reply)
+{
+    try {
+        muzzley::socketstream& socket = *connection.socket;
+        socket << request << std::flush;
+        if (!socket.good()) {
+            return false;
+        }
+        socket >> reply;
+        return !socket.fail();
+    } catch (std::exception& e) {
+        std::cout << "HTTP exchange exception: " << e.what() << std::endl << std::flush;
+        return false;
+    }
+}
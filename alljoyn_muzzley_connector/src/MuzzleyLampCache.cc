@@ -0,0 +1,84 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include "MuzzleyLampCache.h"
+
+MuzzleyLampCache::MuzzleyLampCache(unsigned int ttl) :
+    ttl(ttl)
+{
+}
+
+MuzzleyLampCache::~MuzzleyLampCache()
+{
+}
+
+void MuzzleyLampCache::Update(const std::string& lampID, const lsf::LampState& state)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    time_t now = std::time(0);
+    MuzzleyLampShadow& shadow = shadows[lampID];
+    shadow.state = state;
+    shadow.hasState = true;
+    shadow.reachable = true;
+    shadow.stateUpdated = now;
+    shadow.reachableUpdated = now;
+}
+
+void MuzzleyLampCache::SetUnreachable(const std::string& lampID)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    std::unordered_map<std::string, MuzzleyLampShadow>::iterator it = shadows.find(lampID);
+    if (it == shadows.end()) {
+        it = shadows.insert(std::make_pair(lampID, MuzzleyLampShadow())).first;
+        it->second.hasState = false;
+        it->second.stateUpdated = 0;
+    }
+    it->second.reachable = false;
+    it->second.reachableUpdated = std::time(0);
+}
+
+bool MuzzleyLampCache::GetFresh(const std::string& lampID, MuzzleyLampShadow& shadow) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (ttl == 0) {
+        return false;
+    }
+    std::unordered_map<std::string, MuzzleyLampShadow>::const_iterator it = shadows.find(lampID);
+    if (it == shadows.end() || !it->second.hasState || !it->second.reachable) {
+        return false;
+    }
+    if (difftime(std::time(0), it->second.stateUpdated) >= ttl) {
+        return false;
+    }
+    shadow = it->second;
+    return true;
+}
+
+void MuzzleyLampCache::Remove(const std::string& lampID)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    shadows.erase(lampID);
+}
+
+void MuzzleyLampCache::SetTTL(unsigned int ttl)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    this->ttl = ttl;
+}
@@ -0,0 +1,172 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include "MuzzleyLampRegistry.h"
+#include <atomic>
+#include <unordered_set>
+
+MuzzleyLampRegistry::MuzzleyLampRegistry() :
+    current(std::make_shared<const Lamps>())
+{
+}
+
+MuzzleyLampRegistry::~MuzzleyLampRegistry()
+{
+}
+
+MuzzleyLampRegistry::Snapshot MuzzleyLampRegistry::GetSnapshot() const
+{
+    return std::atomic_load(&current);
+}
+
+bool MuzzleyLampRegistry::Has(const std::string& lampID) const
+{
+    Snapshot lamps = GetSnapshot();
+    return lamps->find(lampID) != lamps->end();
+}
+
+bool MuzzleyLampRegistry::Get(const std::string& lampID, MuzzleyLamp& lamp) const
+{
+    Snapshot lamps = GetSnapshot();
+    Lamps::const_iterator it = lamps->find(lampID);
+    if (it == lamps->end()) {
+        return false;
+    }
+    lamp = it->second;
+    return true;
+}
+
+std::string MuzzleyLampRegistry::GetName(const std::string& lampID) const
+{
+    Snapshot lamps = GetSnapshot();
+    Lamps::const_iterator it = lamps->find(lampID);
+    if (it == lamps->end()) {
+        return std::string();
+    }
+    return it->second.name;
+}
+
+bool MuzzleyLampRegistry::Add(const std::string& lampID, const std::string& name)
+{
+    std::lock_guard<std::mutex> guard(writeLock);
+
+    if (current->find(lampID) != current->end()) {
+        return false;
+    }
+    Lamps* lamps = new Lamps(*current);
+    MuzzleyLamp& lamp = (*lamps)[lampID];
+    lamp.id = lampID;
+    lamp.name = name;
+    Publish(lamps);
+    return true;
+}
+
+bool MuzzleyLampRegistry::SetName(const std::string& lampID, const std::string& name)
+{
+    std::lock_guard<std::mutex> guard(writeLock);
+
+    Lamps::const_iterator it = current->find(lampID);
+    if (it != current->end() && it->second.name == name) {
+        return false;
+    }
+    Lamps* lamps = new Lamps(*current);
+    MuzzleyLamp& lamp = (*lamps)[lampID];
+    lamp.id = lampID;
+    lamp.name = name;
+    Publish(lamps);
+    return true;
+}
+
+bool MuzzleyLampRegistry::Rename(const std::string& lampID, const std::string& name)
+{
+    std::lock_guard<std::mutex> guard(writeLock);
+
+    Lamps::const_iterator it = current->find(lampID);
+    if (it == current->end()) {
+        return false;
+    }
+    if (it->second.name == name) {
+        return true;
+    }
+    Lamps* lamps = new Lamps(*current);
+    (*lamps)[lampID].name = name;
+    Publish(lamps);
+    return true;
+}
+
+bool MuzzleyLampRegistry::Remove(const std::string& lampID)
+{
+    std::lock_guard<std::mutex> guard(writeLock);
+
+    if (current->find(lampID) == current->end()) {
+        return false;
+    }
+    Lamps* lamps = new Lamps(*current);
+    lamps->erase(lampID);
+    Publish(lamps);
+    return true;
+}
+
+void MuzzleyLampRegistry::Clear()
+{
+    std::lock_guard<std::mutex> guard(writeLock);
+    Publish(new Lamps());
+}
+
+void MuzzleyLampRegistry::Reconcile(const std::list<std::string>& lampIDs, const std::string& name, MuzzleyLampDelta& delta)
+{
+    std::lock_guard<std::mutex> guard(writeLock);
+
+    std::unordered_set<std::string> present(lampIDs.begin(), lampIDs.end());
+    Lamps* lamps = new Lamps(*current);
+
+    for (std::list<std::string>::const_iterator it = lampIDs.begin(); it != lampIDs.end(); ++it) {
+        if (lamps->find(*it) != lamps->end()) {
+            continue;
+        }
+        MuzzleyLamp& lamp = (*lamps)[*it];
+        lamp.id = *it;
+        lamp.name = name;
+        delta.added.push_back(*it);
+    }
+
+    for (Lamps::iterator it = lamps->begin(); it != lamps->end();) {
+        if (present.find(it->first) == present.end()) {
+            delta.removed.push_back(it->first);
+            it = lamps->erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (delta.added.empty() && delta.removed.empty()) {
+        delete lamps;
+        return;
+    }
+    Publish(lamps);
+}
+
+size_t MuzzleyLampRegistry::Size() const
+{
+    return GetSnapshot()->size();
+}
+
+void MuzzleyLampRegistry::Publish(Lamps* lamps)
+{
+    // readers holding the old snapshot keep it alive until they drop it
+    std::atomic_store(&current, Snapshot(lamps));
+}
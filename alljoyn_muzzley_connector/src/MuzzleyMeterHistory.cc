@@ -0,0 +1,135 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include "MuzzleyMeterHistory.h"
+
+const time_t MuzzleyMeterHistory::periods[TIER_COUNT] = {1, 60, 3600};
+
+MuzzleyMeterHistory::MuzzleyMeterHistory(size_t seconds, size_t minutes, size_t hours)
+{
+    capacities[TIER_SECOND] = seconds;
+    capacities[TIER_MINUTE] = minutes;
+    capacities[TIER_HOUR] = hours;
+}
+
+MuzzleyMeterHistory::~MuzzleyMeterHistory()
+{
+}
+
+void MuzzleyMeterHistory::Record(Ring& ring, size_t capacity, time_t start, double sample)
+{
+    if (capacity == 0) {
+        return;
+    }
+
+    if (!ring.buckets.empty()) {
+        MuzzleyMeterBucket& newest = ring.buckets[ring.newest];
+        if (start < newest.start) {
+            return;
+        }
+        if (start == newest.start) {
+            if (sample < newest.min) {
+                newest.min = sample;
+            }
+            if (sample > newest.max) {
+                newest.max = sample;
+            }
+            newest.sum += sample;
+            newest.count++;
+            return;
+        }
+    }
+
+    MuzzleyMeterBucket bucket;
+    bucket.start = start;
+    bucket.min = sample;
+    bucket.max = sample;
+    bucket.sum = sample;
+    bucket.count = 1;
+
+    // grows up to capacity once, then overwrites the oldest bucket
+    if (ring.buckets.size() < capacity) {
+        if (ring.buckets.capacity() == 0) {
+            ring.buckets.reserve(capacity);
+        }
+        ring.buckets.push_back(bucket);
+        ring.newest = ring.buckets.size() - 1;
+    } else {
+        ring.newest = (ring.newest + 1) % capacity;
+        ring.buckets[ring.newest] = bucket;
+    }
+}
+
+void MuzzleyMeterHistory::Add(const std::string& plugID, MuzzleyPlugValue value, double sample, time_t when)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    Series& series = plugs[plugID].values[value];
+    for (int i = 0; i < TIER_COUNT; i++) {
+        Record(series.tiers[i], capacities[i], when - when % periods[i], sample);
+    }
+}
+
+std::vector<MuzzleyMeterBucket> MuzzleyMeterHistory::Query(const std::string& plugID, MuzzleyPlugValue value, Tier tier, time_t from, time_t to) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    std::vector<MuzzleyMeterBucket> window;
+    std::unordered_map<std::string, Plug>::const_iterator it = plugs.find(plugID);
+    if (it == plugs.end()) {
+        return window;
+    }
+
+    // the oldest bucket follows the newest one once the ring wrapped
+    const Ring& ring = it->second.values[value].tiers[tier];
+    size_t size = ring.buckets.size();
+    for (size_t i = 1; i <= size; i++) {
+        const MuzzleyMeterBucket& bucket = ring.buckets[(ring.newest + i) % size];
+        if (bucket.start >= from && bucket.start <= to) {
+            window.push_back(bucket);
+        }
+    }
+    return window;
+}
+
+bool MuzzleyMeterHistory::Last(const std::string& plugID, MuzzleyPlugValue value, Tier tier, MuzzleyMeterBucket& bucket) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    std::unordered_map<std::string, Plug>::const_iterator it = plugs.find(plugID);
+    if (it == plugs.end()) {
+        return false;
+    }
+    const Ring& ring = it->second.values[value].tiers[tier];
+    if (ring.buckets.empty()) {
+        return false;
+    }
+    bucket = ring.buckets[ring.newest];
+    return true;
+}
+
+void MuzzleyMeterHistory::Remove(const std::string& plugID)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    plugs.erase(plugID);
+}
+
+size_t MuzzleyMeterHistory::Size() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return plugs.size();
+}
@@ -0,0 +1,158 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include "MuzzleyMeterSampler.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+MuzzleyMeterSampler::MuzzleyMeterSampler(unsigned int minInterval, unsigned int maxInterval, double threshold) :
+    minInterval(minInterval),
+    maxInterval(maxInterval < minInterval ? minInterval : maxInterval),
+    threshold(threshold),
+    running(false)
+{
+}
+
+MuzzleyMeterSampler::~MuzzleyMeterSampler()
+{
+    Stop();
+}
+
+void MuzzleyMeterSampler::Start(Sample sample)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (running) {
+        return;
+    }
+    this->sample = sample;
+    running = true;
+    worker = std::thread(&MuzzleyMeterSampler::Run, this);
+}
+
+void MuzzleyMeterSampler::Stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!running) {
+            return;
+        }
+        running = false;
+        wakeup.notify_one();
+    }
+    worker.join();
+}
+
+void MuzzleyMeterSampler::Watch(const std::string& plugID)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    Plug& plug = plugs[plugID];
+    plug.interval = minInterval;
+    plug.due = Clock::now();
+    plug.hasPower = false;
+    plug.power = 0;
+    plug.changed = false;
+    wakeup.notify_one();
+}
+
+void MuzzleyMeterSampler::Unwatch(const std::string& plugID)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    plugs.erase(plugID);
+}
+
+void MuzzleyMeterSampler::Observe(const std::string& plugID, double power)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    std::unordered_map<std::string, Plug>::iterator it = plugs.find(plugID);
+    if (it == plugs.end()) {
+        return;
+    }
+    Plug& plug = it->second;
+    double delta = std::fabs(power - plug.power);
+    bool significant = plug.hasPower && delta > threshold * std::max(std::fabs(plug.power), 1.0);
+    plug.hasPower = true;
+    plug.power = power;
+    if (!significant) {
+        return;
+    }
+
+    plug.changed = true;
+    if (plug.interval > minInterval) {
+        // an idle plug started drawing, sample it again soon
+        plug.interval = minInterval;
+        Clock::time_point soon = Clock::now() + std::chrono::milliseconds(minInterval);
+        if (soon < plug.due) {
+            plug.due = soon;
+            wakeup.notify_one();
+        }
+    }
+}
+
+unsigned int MuzzleyMeterSampler::GetInterval(const std::string& plugID) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    std::unordered_map<std::string, Plug>::const_iterator it = plugs.find(plugID);
+    return it == plugs.end() ? 0 : it->second.interval;
+}
+
+void MuzzleyMeterSampler::Run()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while (running) {
+        Clock::time_point now = Clock::now();
+        Clock::time_point next = Clock::time_point::max();
+        std::vector<std::string> due;
+        for (std::unordered_map<std::string, Plug>::iterator it = plugs.begin(); it != plugs.end(); ++it) {
+            Plug& plug = it->second;
+            if (plug.due <= now) {
+                due.push_back(it->first);
+                // no significant change since the last sample, back off
+                if (!plug.changed) {
+                    plug.interval = std::min(plug.interval * 2, maxInterval);
+                }
+                plug.changed = false;
+                plug.due = now + std::chrono::milliseconds(plug.interval);
+            }
+            if (plug.due < next) {
+                next = plug.due;
+            }
+        }
+
+        if (!due.empty()) {
+            guard.unlock();
+            for (size_t i = 0; i < due.size(); i++) {
+                try {
+                    sample(due[i]);
+                } catch (std::exception& e) {
+                    std::cout << "Meter sampler exception: " << e.what() << std::endl << std::flush;
+                }
+            }
+            guard.lock();
+            continue;
+        }
+
+        if (next == Clock::time_point::max()) {
+            wakeup.wait(guard);
+        } else {
+            wakeup.wait_until(guard, next);
+        }
+    }
+}
@@ -0,0 +1,239 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include "MuzzleyNameResolver.h"
+
+MuzzleyNameResolver::MuzzleyNameResolver(unsigned int window, unsigned int timeout, unsigned int backoff, unsigned int maxFailures,
+                                         unsigned int negativeTTL, unsigned int maxBatch, MuzzleyScheduler::Defer defer) :
+    window(window ? window : 1),
+    timeout(timeout),
+    backoff(backoff),
+    maxFailures(maxFailures),
+    negativeTTL(negativeTTL),
+    maxBatch(maxBatch ? maxBatch : 1),
+    defer(defer),
+    inFlight(0),
+    queries(0)
+{
+}
+
+MuzzleyNameResolver::~MuzzleyNameResolver()
+{
+}
+
+void MuzzleyNameResolver::SetHandlers(Query query, Resolved resolved)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    this->query = query;
+    this->resolved = resolved;
+}
+
+void MuzzleyNameResolver::Resolve(const std::vector<std::string>& lampIDs)
+{
+    Lamps issue;
+    Names batch;
+    Lamps retries;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        time_t now = std::time(0);
+        for (size_t i = 0; i < lampIDs.size(); i++) {
+            std::unordered_map<std::string, Lamp>::iterator it = lamps.find(lampIDs[i]);
+            if (it != lamps.end()) {
+                if (it->second.state != NEGATIVE || difftime(now, it->second.since) < negativeTTL) {
+                    continue;
+                }
+                // the negative entry expired, try again from scratch
+                it->second.failures = 0;
+            } else {
+                it = lamps.insert(std::make_pair(lampIDs[i], Lamp())).first;
+                it->second.failures = 0;
+            }
+            it->second.state = QUEUED;
+            it->second.since = now;
+            queue.push_back(lampIDs[i]);
+        }
+
+        Pump(issue, batch);
+    }
+    Run(issue, batch, retries);
+}
+
+void MuzzleyNameResolver::Reply(const std::string& lampID, bool ok, const std::string& name)
+{
+    Lamps issue;
+    Names batch;
+    Lamps retries;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        std::unordered_map<std::string, Lamp>::iterator it = lamps.find(lampID);
+        if (it == lamps.end() || it->second.state != IN_FLIGHT) {
+            return;
+        }
+        inFlight--;
+        if (ok) {
+            names.push_back(std::make_pair(lampID, name));
+            lamps.erase(it);
+        } else {
+            Fail(lampID, it->second, std::time(0), retries);
+        }
+
+        Pump(issue, batch);
+    }
+    Run(issue, batch, retries);
+}
+
+void MuzzleyNameResolver::Forget(const std::string& lampID)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    std::unordered_map<std::string, Lamp>::iterator it = lamps.find(lampID);
+    if (it == lamps.end()) {
+        return;
+    }
+    // a queued id is skipped by Pump once its entry is gone
+    if (it->second.state == IN_FLIGHT) {
+        inFlight--;
+    }
+    lamps.erase(it);
+}
+
+void MuzzleyNameResolver::Fail(const std::string& lampID, Lamp& lamp, time_t now, Lamps& retries)
+{
+    lamp.failures++;
+    lamp.since = now;
+    if (lamp.failures >= maxFailures) {
+        lamp.state = NEGATIVE;
+        return;
+    }
+    lamp.state = BACKING_OFF;
+    retries.push_back(std::make_pair(lampID, (backoff << (lamp.failures - 1)) * 1000));
+}
+
+void MuzzleyNameResolver::Expire(const std::string& lampID, unsigned int sent)
+{
+    Lamps issue;
+    Names batch;
+    Lamps retries;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        // the timer of an older query of the lamp finds another one in flight
+        std::unordered_map<std::string, Lamp>::iterator it = lamps.find(lampID);
+        if (it == lamps.end() || it->second.state != IN_FLIGHT || it->second.query != sent) {
+            return;
+        }
+        inFlight--;
+        Fail(lampID, it->second, std::time(0), retries);
+        Pump(issue, batch);
+    }
+    Run(issue, batch, retries);
+}
+
+void MuzzleyNameResolver::Retry(const std::string& lampID)
+{
+    Lamps issue;
+    Names batch;
+    Lamps retries;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        std::unordered_map<std::string, Lamp>::iterator it = lamps.find(lampID);
+        if (it == lamps.end() || it->second.state != BACKING_OFF) {
+            return;
+        }
+        it->second.state = QUEUED;
+        queue.push_back(lampID);
+        Pump(issue, batch);
+    }
+    Run(issue, batch, retries);
+}
+
+void MuzzleyNameResolver::Pump(Lamps& issue, Names& batch)
+{
+    time_t now = std::time(0);
+    while (inFlight < window && !queue.empty()) {
+        std::string lampID = queue.front();
+        queue.pop_front();
+
+        std::unordered_map<std::string, Lamp>::iterator it = lamps.find(lampID);
+        if (it == lamps.end() || it->second.state != QUEUED) {
+            continue;
+        }
+        it->second.state = IN_FLIGHT;
+        it->second.since = now;
+        it->second.query = ++queries;
+        inFlight++;
+        issue.push_back(std::make_pair(lampID, it->second.query));
+    }
+
+    // the batch is handed over when it is full or nothing else is coming
+    if (!names.empty() && (names.size() >= maxBatch || (inFlight == 0 && queue.empty()))) {
+        batch.swap(names);
+    }
+}
+
+void MuzzleyNameResolver::Run(Lamps& issue, Names& batch, Lamps& retries)
+{
+    // queries that could not be sent fail here and free their slot for the
+    // next ones, in a loop rather than through Reply
+    for (;;) {
+        for (size_t i = 0; i < retries.size(); i++) {
+            std::string lampID = retries[i].first;
+            defer(retries[i].second, [this, lampID] () {
+                Retry(lampID);
+            });
+        }
+        retries.clear();
+
+        std::vector<std::string> failed;
+        for (size_t i = 0; i < issue.size(); i++) {
+            if (!query || !query(issue[i].first)) {
+                failed.push_back(issue[i].first);
+                continue;
+            }
+            std::string lampID = issue[i].first;
+            unsigned int sent = issue[i].second;
+            defer(timeout * 1000, [this, lampID, sent] () {
+                Expire(lampID, sent);
+            });
+        }
+        issue.clear();
+
+        if (!batch.empty() && resolved) {
+            resolved(batch);
+        }
+        batch.clear();
+
+        if (failed.empty()) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        time_t now = std::time(0);
+        for (size_t i = 0; i < failed.size(); i++) {
+            std::unordered_map<std::string, Lamp>::iterator it = lamps.find(failed[i]);
+            if (it == lamps.end() || it->second.state != IN_FLIGHT) {
+                continue;
+            }
+            inFlight--;
+            Fail(failed[i], it->second, now, retries);
+        }
+        Pump(issue, batch);
+    }
+}
@@ -0,0 +1,101 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include "MuzzleyPendingCalls.h"
+
+MuzzleyPendingCalls::MuzzleyPendingCalls(unsigned int window) :
+    window(window)
+{
+}
+
+MuzzleyPendingCalls::~MuzzleyPendingCalls()
+{
+}
+
+std::string MuzzleyPendingCalls::Key(const std::string& method, const std::string& id)
+{
+    std::string key;
+    key.reserve(method.size() + id.size() + 1);
+    key.append(method);
+    key.push_back('/');
+    key.append(id);
+    return key;
+}
+
+bool MuzzleyPendingCalls::Join(const std::string& method, const std::string& id)
+{
+    return Join(method, id, Continuation());
+}
+
+bool MuzzleyPendingCalls::Join(const std::string& method, const std::string& id, Continuation then)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    time_t now = std::time(0);
+    std::pair<std::unordered_map<std::string, Call>::iterator, bool> inserted = calls.insert(std::make_pair(Key(method, id), Call()));
+    Call& call = inserted.first->second;
+    if (then) {
+        call.continuations.push_back(then);
+    }
+
+    if (!inserted.second && difftime(now, call.issued) < window) {
+        call.waiters++;
+        return false;
+    }
+
+    // new call, or the previous one was lost and is issued again
+    call.issued = now;
+    call.waiters = inserted.second ? 1 : call.waiters + 1;
+    return true;
+}
+
+unsigned int MuzzleyPendingCalls::Complete(const std::string& method, const std::string& id, bool ok)
+{
+    std::vector<Continuation> continuations;
+    unsigned int waiters = 0;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        std::unordered_map<std::string, Call>::iterator it = calls.find(Key(method, id));
+        if (it == calls.end()) {
+            return 0;
+        }
+        waiters = it->second.waiters;
+        continuations.swap(it->second.continuations);
+        calls.erase(it);
+    }
+
+    // unlocked, a continuation may issue the call again
+    for (size_t i = 0; i < continuations.size(); i++) {
+        continuations[i](ok);
+    }
+    return waiters;
+}
+
+bool MuzzleyPendingCalls::InFlight(const std::string& method, const std::string& id) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    std::unordered_map<std::string, Call>::const_iterator it = calls.find(Key(method, id));
+    return it != calls.end() && difftime(std::time(0), it->second.issued) < window;
+}
+
+size_t MuzzleyPendingCalls::Size() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return calls.size();
+}
@@ -0,0 +1,192 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include "MuzzleyPlugRegistry.h"
+
+MuzzleyPlugRegistry::MuzzleyPlugRegistry() :
+    count(0)
+{
+}
+
+MuzzleyPlugRegistry::~MuzzleyPlugRegistry()
+{
+}
+
+MuzzleyPlug* MuzzleyPlugRegistry::Find(const std::string& plugID) const
+{
+    std::unordered_map<std::string, unsigned int>::const_iterator it = interned.find(plugID);
+    if (it == interned.end()) {
+        return NULL;
+    }
+    return plugs[it->second].get();
+}
+
+void MuzzleyPlugRegistry::Unwatch(const MuzzleyPlug& plug)
+{
+    for (int i = 0; i < PLUG_VALUE_COUNT; i++) {
+        if (plug.properties[i] != NULL) {
+            watched.erase(plug.properties[i]);
+        }
+    }
+}
+
+MuzzleyPlug MuzzleyPlugRegistry::Add(const std::string& plugID, const std::string& name,
+                                     ajn::services::Property* const properties[PLUG_VALUE_COUNT],
+                                     ajn::services::Action* const actions[PLUG_ACTION_COUNT])
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    std::pair<std::unordered_map<std::string, unsigned int>::iterator, bool> inserted = interned.insert(std::make_pair(plugID, (unsigned int)plugs.size()));
+    if (inserted.second) {
+        plugs.push_back(std::unique_ptr<MuzzleyPlug>());
+    }
+    std::unique_ptr<MuzzleyPlug>& slot = plugs[inserted.first->second];
+    if (!slot) {
+        slot.reset(new MuzzleyPlug());
+        count++;
+    } else {
+        Unwatch(*slot);
+    }
+
+    MuzzleyPlug& plug = *slot;
+    plug.id = plugID;
+    plug.name = name;
+    plug.index = inserted.first->second;
+    plug.added = std::time(0);
+    for (int i = 0; i < PLUG_VALUE_COUNT; i++) {
+        plug.properties[i] = properties[i];
+        plug.values[i].clear();
+        plug.updated[i] = 0;
+        if (properties[i] != NULL) {
+            watched[properties[i]] = std::make_pair(plug.index, (MuzzleyPlugValue)i);
+        }
+    }
+    for (int i = 0; i < PLUG_ACTION_COUNT; i++) {
+        plug.actions[i] = actions[i];
+    }
+    return plug;
+}
+
+bool MuzzleyPlugRegistry::Remove(const std::string& plugID)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    // the id stays interned, the plug gets the same slot if it comes back
+    std::unordered_map<std::string, unsigned int>::iterator it = interned.find(plugID);
+    if (it == interned.end() || !plugs[it->second]) {
+        return false;
+    }
+    Unwatch(*plugs[it->second]);
+    plugs[it->second].reset();
+    count--;
+    return true;
+}
+
+bool MuzzleyPlugRegistry::Has(const std::string& plugID) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return Find(plugID) != NULL;
+}
+
+bool MuzzleyPlugRegistry::Get(const std::string& plugID, MuzzleyPlug& plug) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    MuzzleyPlug* found = Find(plugID);
+    if (found == NULL) {
+        return false;
+    }
+    plug = *found;
+    return true;
+}
+
+ajn::services::Property* MuzzleyPlugRegistry::GetProperty(const std::string& plugID, MuzzleyPlugValue value) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    MuzzleyPlug* found = Find(plugID);
+    return found == NULL ? NULL : found->properties[value];
+}
+
+ajn::services::Action* MuzzleyPlugRegistry::GetAction(const std::string& plugID, MuzzleyPlugAction action) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    MuzzleyPlug* found = Find(plugID);
+    return found == NULL ? NULL : found->actions[action];
+}
+
+bool MuzzleyPlugRegistry::FindProperty(const ajn::services::Property* property, std::string& plugID, MuzzleyPlugValue& value) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    std::unordered_map<const ajn::services::Property*, std::pair<unsigned int, MuzzleyPlugValue> >::const_iterator it = watched.find(property);
+    if (it == watched.end()) {
+        return false;
+    }
+    plugID = plugs[it->second.first]->id;
+    value = it->second.second;
+    return true;
+}
+
+bool MuzzleyPlugRegistry::SetValue(const std::string& plugID, MuzzleyPlugValue value, const std::string& data)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    MuzzleyPlug* found = Find(plugID);
+    if (found == NULL) {
+        return false;
+    }
+    if (found->updated[value] != 0 && found->values[value] == data) {
+        return false;
+    }
+    found->values[value] = data;
+    found->updated[value] = std::time(0);
+    return true;
+}
+
+bool MuzzleyPlugRegistry::GetValue(const std::string& plugID, MuzzleyPlugValue value, std::string& data) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    MuzzleyPlug* found = Find(plugID);
+    if (found == NULL || found->updated[value] == 0) {
+        return false;
+    }
+    data = found->values[value];
+    return true;
+}
+
+std::vector<MuzzleyPlug> MuzzleyPlugRegistry::List() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    std::vector<MuzzleyPlug> list;
+    list.reserve(count);
+    for (size_t i = 0; i < plugs.size(); i++) {
+        if (plugs[i]) {
+            list.push_back(*plugs[i]);
+        }
+    }
+    return list;
+}
+
+size_t MuzzleyPlugRegistry::Size() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return count;
+}
@@ -0,0 +1,261 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include "MuzzleyPublisher.h"
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+MuzzleyPublisher::MuzzleyPublisher(size_t capacity) :
+    dropped(0),
+    client(0),
+    running(false),
+    sleeping(false),
+    batchWindow(0)
+{
+    Init(replies, capacity);
+    Init(publishes, capacity);
+}
+
+void MuzzleyPublisher::Init(Ring& ring, size_t capacity)
+{
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    ring.cells = std::vector<Cell>(size);
+    for (size_t i = 0; i < size; i++) {
+        ring.cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    ring.mask = size - 1;
+    ring.head.store(0);
+    ring.tail.store(0);
+}
+
+MuzzleyPublisher::~MuzzleyPublisher()
+{
+    Stop();
+}
+
+void MuzzleyPublisher::Start(muzzley::Client* client)
+{
+    if (running.exchange(true)) {
+        return;
+    }
+    this->client = client;
+    sender = std::thread(&MuzzleyPublisher::Run, this);
+}
+
+void MuzzleyPublisher::Stop()
+{
+    if (!running.exchange(false)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        wakeup.notify_one();
+    }
+    sender.join();
+}
+
+void MuzzleyPublisher::Reply(const muzzley::Message& message)
+{
+    Outgoing outgoing;
+    outgoing.reply = true;
+    outgoing.message = message;
+    Push(replies, outgoing);
+}
+
+void MuzzleyPublisher::Publish(const muzzley::Subscription& subscription, const muzzley::Message& message,
+                               const std::string& channel, const std::string& component, const std::string& property, const muzzley::JSONObj& data)
+{
+    Outgoing outgoing;
+    outgoing.reply = false;
+    outgoing.subscription = subscription;
+    outgoing.message = message;
+    outgoing.channel = channel;
+    outgoing.component = component;
+    outgoing.property = property;
+    outgoing.data = data;
+    Push(publishes, outgoing);
+}
+
+void MuzzleyPublisher::SetBatchWindow(unsigned int milliseconds)
+{
+    batchWindow.store(milliseconds);
+}
+
+size_t MuzzleyPublisher::GetDropped() const
+{
+    return dropped.load();
+}
+
+void MuzzleyPublisher::Push(Ring& ring, Outgoing& outgoing)
+{
+    size_t position = ring.head.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = ring.cells[position & ring.mask];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)position;
+        if (diff == 0) {
+            if (ring.head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                cell.outgoing = outgoing;
+                cell.sequence.store(position + 1, std::memory_order_release);
+                break;
+            }
+        } else if (diff < 0) {
+            // full, the oldest frame makes room
+            Outgoing oldest;
+            if (Pop(ring, oldest)) {
+                size_t count = ++dropped;
+                if ((count & (count - 1)) == 0) {
+                    std::cout << "Publisher queue full, " << count << " frames dropped" << std::endl << std::flush;
+                }
+            }
+            position = ring.head.load(std::memory_order_relaxed);
+        } else {
+            position = ring.head.load(std::memory_order_relaxed);
+        }
+    }
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load()) {
+        std::lock_guard<std::mutex> guard(lock);
+        wakeup.notify_one();
+    }
+}
+
+bool MuzzleyPublisher::Pop(Outgoing& outgoing)
+{
+    return Pop(replies, outgoing) || Pop(publishes, outgoing);
+}
+
+bool MuzzleyPublisher::Pop(Ring& ring, Outgoing& outgoing)
+{
+    // producers pop too when the ring is full, so the slot is claimed first
+    size_t position = ring.tail.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = ring.cells[position & ring.mask];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)(position + 1);
+        if (diff == 0) {
+            if (ring.tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                outgoing = cell.outgoing;
+                cell.outgoing = Outgoing();
+                cell.sequence.store(position + ring.mask + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            position = ring.tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void MuzzleyPublisher::Send(Outgoing& outgoing)
+{
+    try{
+        if (outgoing.reply) {
+            client->reply(outgoing.message, outgoing.message);
+        } else {
+            client->trigger(muzzley::Publish, outgoing.subscription, outgoing.message);
+        }
+    }catch(std::exception& e){
+        std::cout << "Publisher exception: " << e.what() << std::endl << std::flush;
+    }
+}
+
+void MuzzleyPublisher::Batch(Outgoing& outgoing)
+{
+    if (outgoing.reply || batchWindow.load() == 0) {
+        Send(outgoing);
+        return;
+    }
+    if (batches.empty()) {
+        batchDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(batchWindow.load());
+    }
+    batches[outgoing.channel][std::make_pair(outgoing.component, outgoing.property)] = outgoing;
+}
+
+void MuzzleyPublisher::Flush()
+{
+    for (Batches::iterator bit = batches.begin(); bit != batches.end(); ++bit) {
+        // a lone publish goes out as it was queued
+        if (bit->second.size() == 1) {
+            Send(bit->second.begin()->second);
+            continue;
+        }
+
+        muzzley::JSONArr updates;
+        Outgoing frame;
+        frame.reply = false;
+        for (std::map<std::pair<std::string, std::string>, Outgoing>::iterator it = bit->second.begin(); it != bit->second.end(); ++it) {
+            muzzley::JSONObj update = JSON(
+                "component" << it->second.component <<
+                "property" << it->second.property <<
+                "data" << it->second.data
+            );
+            updates << update;
+            frame.subscription = it->second.subscription;
+        }
+        frame.subscription.setComponent("*");
+        frame.subscription.setProperty("*");
+        frame.message.setData(JSON(
+            "io" << "i" <<
+            "batch" << updates
+        ));
+        Send(frame);
+    }
+    batches.clear();
+}
+
+void MuzzleyPublisher::Run()
+{
+    Outgoing outgoing;
+    for (;;) {
+        while (Pop(outgoing)) {
+            Batch(outgoing);
+        }
+        if (!batches.empty() && (std::chrono::steady_clock::now() >= batchDeadline || !running.load())) {
+            Flush();
+        }
+
+        std::unique_lock<std::mutex> guard(lock);
+        sleeping.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // a producer that missed the flag has its message in the ring by now
+        if (Pop(outgoing)) {
+            sleeping.store(false);
+            guard.unlock();
+            Batch(outgoing);
+            continue;
+        }
+        if (!running.load()) {
+            sleeping.store(false);
+            guard.unlock();
+            Flush();
+            break;
+        }
+        if (batches.empty()) {
+            wakeup.wait_for(guard, std::chrono::seconds(1));
+        } else {
+            wakeup.wait_until(guard, batchDeadline);
+        }
+        sleeping.store(false);
+    }
+}
@@ -0,0 +1,207 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include "MuzzleyRequestTable.h"
+#include <algorithm>
+
+MuzzleyRequestTable::MuzzleyRequestTable(unsigned int timeout, unsigned int wheelSize) :
+    timeout(timeout),
+    wheelSize(wheelSize ? wheelSize : 1),
+    nextId(1),
+    currentTick(std::time(0)),
+    wheel(wheelSize ? wheelSize : 1)
+{
+}
+
+MuzzleyRequestTable::~MuzzleyRequestTable()
+{
+}
+
+bool MuzzleyRequestTable::Add(const std::string& component, const std::string& property, const std::string& cid, int t, const std::string& type)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    RequestId id = nextId++;
+    Entry& entry = entries[id];
+    entry.request.component = component;
+    entry.request.property = property;
+    entry.request.cid = cid;
+    entry.request.t = t;
+    entry.request.time = std::time(0);
+    entry.request.type = type;
+    entry.deadline = entry.request.time + timeout;
+
+    index[component][property].push_back(id);
+    wheel[entry.deadline % wheelSize].push_back(id);
+    return true;
+}
+
+size_t MuzzleyRequestTable::Take(const std::string& component, const std::string& property, std::vector<MuzzleyRequest>& requests)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    ComponentIndex::iterator cit = index.find(component);
+    if (cit == index.end()) {
+        return 0;
+    }
+    PropertyIndex::iterator pit = cit->second.find(property);
+    if (pit == cit->second.end()) {
+        return 0;
+    }
+
+    size_t count = 0;
+    for (Waiters::iterator it = pit->second.begin(); it != pit->second.end(); ++it) {
+        std::unordered_map<RequestId, Entry>::iterator eit = entries.find(*it);
+        if (eit == entries.end()) {
+            continue;
+        }
+        requests.push_back(eit->second.request);
+        entries.erase(eit);
+        count++;
+    }
+
+    // wheel slots still hold the ids, they are skipped when their tick comes
+    cit->second.erase(pit);
+    if (cit->second.empty()) {
+        index.erase(cit);
+    }
+    return count;
+}
+
+bool MuzzleyRequestTable::Has(const std::string& component, const std::string& property) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    ComponentIndex::const_iterator cit = index.find(component);
+    if (cit == index.end()) {
+        return false;
+    }
+    return cit->second.find(property) != cit->second.end();
+}
+
+void MuzzleyRequestTable::Unlink(RequestId id, const MuzzleyRequest& request)
+{
+    ComponentIndex::iterator cit = index.find(request.component);
+    if (cit == index.end()) {
+        return;
+    }
+    PropertyIndex::iterator pit = cit->second.find(request.property);
+    if (pit == cit->second.end()) {
+        return;
+    }
+
+    Waiters::iterator it = std::find(pit->second.begin(), pit->second.end(), id);
+    if (it != pit->second.end()) {
+        pit->second.erase(it);
+    }
+    if (pit->second.empty()) {
+        cit->second.erase(pit);
+        if (cit->second.empty()) {
+            index.erase(cit);
+        }
+    }
+}
+
+size_t MuzzleyRequestTable::Expire(time_t now, std::vector<MuzzleyRequest>& expired)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (now <= currentTick) {
+        return 0;
+    }
+
+    // after a long pause (or a clock jump) every slot is due exactly once
+    time_t ticks = now - currentTick;
+    if (ticks > (time_t)wheelSize) {
+        ticks = wheelSize;
+    }
+
+    size_t count = 0;
+    for (time_t tick = now - ticks + 1; tick <= now; tick++) {
+        std::vector<RequestId>& slot = wheel[tick % wheelSize];
+        std::vector<RequestId> keep;
+
+        for (size_t i = 0; i < slot.size(); i++) {
+            std::unordered_map<RequestId, Entry>::iterator eit = entries.find(slot[i]);
+            if (eit == entries.end()) {
+                continue;
+            }
+            if (eit->second.deadline > now) {
+                // not due yet, the timeout is longer than one wheel turn
+                keep.push_back(slot[i]);
+                continue;
+            }
+            Unlink(slot[i], eit->second.request);
+            expired.push_back(eit->second.request);
+            entries.erase(eit);
+            count++;
+        }
+        slot.swap(keep);
+    }
+
+    currentTick = now;
+    return count;
+}
+
+size_t MuzzleyRequestTable::RemoveComponent(const std::string& component, std::vector<MuzzleyRequest>& removed)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    ComponentIndex::iterator cit = index.find(component);
+    if (cit == index.end()) {
+        return 0;
+    }
+
+    size_t count = 0;
+    for (PropertyIndex::iterator pit = cit->second.begin(); pit != cit->second.end(); ++pit) {
+        for (Waiters::iterator it = pit->second.begin(); it != pit->second.end(); ++it) {
+            std::unordered_map<RequestId, Entry>::iterator eit = entries.find(*it);
+            if (eit == entries.end()) {
+                continue;
+            }
+            removed.push_back(eit->second.request);
+            entries.erase(eit);
+            count++;
+        }
+    }
+    index.erase(cit);
+    return count;
+}
+
+void MuzzleyRequestTable::GetComponents(std::vector<std::string>& components) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    for (ComponentIndex::const_iterator cit = index.begin(); cit != index.end(); ++cit) {
+        components.push_back(cit->first);
+    }
+}
+
+void MuzzleyRequestTable::GetRequests(std::vector<MuzzleyRequest>& requests) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    for (std::unordered_map<RequestId, Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+        requests.push_back(it->second.request);
+    }
+}
+
+size_t MuzzleyRequestTable::Size() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return entries.size();
+}
@@ -0,0 +1,114 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include "MuzzleyScheduler.h"
+#include <glib-unix.h>
+#include <iostream>
+
+MuzzleyScheduler::MuzzleyScheduler()
+{
+    context = g_main_context_new();
+    loop = g_main_loop_new(context, FALSE);
+}
+
+MuzzleyScheduler::~MuzzleyScheduler()
+{
+    g_main_loop_unref(loop);
+    g_main_context_unref(context);
+}
+
+gboolean MuzzleyScheduler::Dispatch(gpointer data)
+{
+    Task* task = (Task*)data;
+    try{
+        return (*task)() ? TRUE : FALSE;
+    }catch(std::exception& e){
+        std::cout << "Scheduler task exception: " << e.what() << std::endl << std::flush;
+        return TRUE;
+    }
+}
+
+void MuzzleyScheduler::Destroy(gpointer data)
+{
+    delete (Task*)data;
+}
+
+guint MuzzleyScheduler::Attach(GSource* source, Task* task)
+{
+    g_source_set_callback(source, &MuzzleyScheduler::Dispatch, task, &MuzzleyScheduler::Destroy);
+    guint id = g_source_attach(source, context);
+    g_source_unref(source);
+    return id;
+}
+
+guint MuzzleyScheduler::Every(guint interval, Task task)
+{
+    return Attach(g_timeout_source_new(interval), new Task(task));
+}
+
+guint MuzzleyScheduler::EverySeconds(guint interval, Task task)
+{
+    return Attach(g_timeout_source_new_seconds(interval), new Task(task));
+}
+
+guint MuzzleyScheduler::After(guint delay, std::function<void ()> task)
+{
+    return Attach(g_timeout_source_new(delay), new Task([task] () -> bool {
+        task();
+        return false;
+    }));
+}
+
+guint MuzzleyScheduler::Post(std::function<void ()> task)
+{
+    return Attach(g_idle_source_new(), new Task([task] () -> bool {
+        task();
+        return false;
+    }));
+}
+
+MuzzleyScheduler::Defer MuzzleyScheduler::GetDefer()
+{
+    return [this] (unsigned int delay, std::function<void ()> task) {
+        After(delay, task);
+    };
+}
+
+guint MuzzleyScheduler::OnSignal(int signum, std::function<void ()> task)
+{
+    return Attach(g_unix_signal_source_new(signum), new Task([task] () -> bool {
+        task();
+        return true;
+    }));
+}
+
+void MuzzleyScheduler::Run()
+{
+    g_main_context_push_thread_default(context);
+    g_main_loop_run(loop);
+    g_main_context_pop_thread_default(context);
+}
+
+void MuzzleyScheduler::Stop()
+{
+    g_main_loop_quit(loop);
+}
+
+GMainContext* MuzzleyScheduler::GetContext()
+{
+    return context;
+}
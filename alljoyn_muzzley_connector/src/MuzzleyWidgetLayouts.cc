@@ -0,0 +1,96 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include "MuzzleyWidgetLayouts.h"
+#include <sstream>
+
+using namespace ajn::services;
+
+MuzzleyWidgetLayouts::MuzzleyWidgetLayouts()
+{
+}
+
+MuzzleyWidgetLayouts::~MuzzleyWidgetLayouts()
+{
+}
+
+std::string MuzzleyWidgetLayouts::Key(const std::string& manufacturer, const std::string& model, unsigned int version)
+{
+    std::ostringstream key;
+    key << manufacturer << '\n' << model << '\n' << version;
+    return key.str();
+}
+
+bool MuzzleyWidgetLayouts::Get(const std::string& key, Layout& layout) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    std::unordered_map<std::string, Layout>::const_iterator it = layouts.find(key);
+    if (it == layouts.end()) {
+        return false;
+    }
+    layout = it->second;
+    return true;
+}
+
+void MuzzleyWidgetLayouts::Set(const std::string& key, const Layout& layout)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    layouts[key] = layout;
+}
+
+void MuzzleyWidgetLayouts::Remove(const std::string& key)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    layouts.erase(key);
+}
+
+Widget* MuzzleyWidgetLayouts::Find(Container* root, const Path& path)
+{
+    Widget* widget = root;
+    for (size_t i = 0; i < path.size(); i++) {
+        if (widget == NULL || widget->getWidgetType() != WIDGET_TYPE_CONTAINER) {
+            return NULL;
+        }
+        const std::vector<Widget*>& children = ((Container*)widget)->getChildWidgets();
+        if (path[i] >= children.size()) {
+            return NULL;
+        }
+        widget = children[path[i]];
+    }
+    return widget;
+}
+
+bool MuzzleyWidgetLayouts::Bind(Container* root, const Layout& layout, std::vector<Widget*>& widgets)
+{
+    widgets.assign(layout.size(), (Widget*)NULL);
+    if (root == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < layout.size(); i++) {
+        if (layout[i].path.empty()) {
+            continue;
+        }
+        Widget* widget = Find(root, layout[i].path);
+        // a firmware that reorders widgets of the same type is caught by the label
+        if (widget == NULL || widget->getWidgetType() != layout[i].type || layout[i].label != widget->getLabel().c_str()) {
+            return false;
+        }
+        widgets[i] = widget;
+    }
+    return true;
+}
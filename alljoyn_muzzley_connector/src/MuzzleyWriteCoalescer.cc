@@ -0,0 +1,171 @@
+/*****************************************************************************
+ * Copyright (c) 2014, AllSeen Alliance. All rights reserved.
+ * Copyright (c) 2014, Muzzley
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include "MuzzleyWriteCoalescer.h"
+
+MuzzleyWriteCoalescer::MuzzleyWriteCoalescer(unsigned int window, unsigned int timeout, MuzzleyScheduler::Defer defer) :
+    window(window),
+    timeout(timeout),
+    defer(defer)
+{
+}
+
+MuzzleyWriteCoalescer::~MuzzleyWriteCoalescer()
+{
+}
+
+void MuzzleyWriteCoalescer::Submit(const std::string& lampID, int kind, Write write)
+{
+    Actions actions = Actions();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        std::pair<std::unordered_map<std::string, Lamp>::iterator, bool> inserted = lamps.insert(std::make_pair(lampID, Lamp()));
+        Lamp& lamp = inserted.first->second;
+        if (inserted.second) {
+            lamp.inFlight = false;
+            lamp.flushScheduled = false;
+            lamp.generation = 0;
+            lamp.nextIssue = Clock::now();
+        }
+
+        // last writer wins, keeping the position of the first write of the kind
+        bool replaced = false;
+        for (size_t i = 0; i < lamp.pending.size(); i++) {
+            if (lamp.pending[i].first == kind) {
+                lamp.pending[i].second = write;
+                replaced = true;
+                break;
+            }
+        }
+        if (!replaced) {
+            lamp.pending.push_back(std::make_pair(kind, write));
+        }
+
+        Issue(lamp, actions);
+    }
+    Run(lampID, actions);
+}
+
+void MuzzleyWriteCoalescer::Completed(const std::string& lampID)
+{
+    Actions actions = Actions();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        std::unordered_map<std::string, Lamp>::iterator it = lamps.find(lampID);
+        if (it == lamps.end()) {
+            return;
+        }
+        Lamp& lamp = it->second;
+        if (!lamp.inFlight) {
+            return;
+        }
+        lamp.inFlight = false;
+        Issue(lamp, actions);
+    }
+    Run(lampID, actions);
+}
+
+void MuzzleyWriteCoalescer::Forget(const std::string& lampID)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    lamps.erase(lampID);
+}
+
+void MuzzleyWriteCoalescer::SetWindow(unsigned int window)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    this->window = window;
+}
+
+void MuzzleyWriteCoalescer::Issue(Lamp& lamp, Actions& actions)
+{
+    if (lamp.inFlight || lamp.pending.empty()) {
+        return;
+    }
+
+    Clock::time_point now = Clock::now();
+    if (now < lamp.nextIssue) {
+        if (!lamp.flushScheduled) {
+            lamp.flushScheduled = true;
+            actions.flush = true;
+            actions.flushDelay = (unsigned int)std::chrono::duration_cast<std::chrono::milliseconds>(lamp.nextIssue - now).count() + 1;
+        }
+        return;
+    }
+
+    actions.write = lamp.pending.front().second;
+    lamp.pending.erase(lamp.pending.begin());
+    lamp.inFlight = true;
+    lamp.generation++;
+    lamp.nextIssue = now + std::chrono::milliseconds(window);
+    actions.generation = lamp.generation;
+}
+
+void MuzzleyWriteCoalescer::Run(const std::string& lampID, Actions& actions)
+{
+    if (actions.flush) {
+        defer(actions.flushDelay, [this, lampID] () {
+            Flush(lampID);
+        });
+    }
+    if (!actions.write) {
+        return;
+    }
+
+    unsigned long generation = actions.generation;
+    defer(timeout, [this, lampID, generation] () {
+        Expire(lampID, generation);
+    });
+    // a write that was not sent gets no reply, the next one goes out right away
+    if (!actions.write()) {
+        Expire(lampID, generation);
+    }
+}
+
+void MuzzleyWriteCoalescer::Flush(const std::string& lampID)
+{
+    Actions actions = Actions();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        std::unordered_map<std::string, Lamp>::iterator it = lamps.find(lampID);
+        if (it == lamps.end()) {
+            return;
+        }
+        it->second.flushScheduled = false;
+        Issue(it->second, actions);
+    }
+    Run(lampID, actions);
+}
+
+void MuzzleyWriteCoalescer::Expire(const std::string& lampID, unsigned long generation)
+{
+    Actions actions = Actions();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        std::unordered_map<std::string, Lamp>::iterator it = lamps.find(lampID);
+        if (it == lamps.end() || !it->second.inFlight || it->second.generation != generation) {
+            return;
+        }
+        it->second.inFlight = false;
+        Issue(it->second, actions);
+    }
+    Run(lampID, actions);
+}